@@ -5,23 +5,263 @@
 #include <chrono>
 #include <random>
 #include <iomanip>
+#include <algorithm>
+#include <string>
+#include <limits>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <condition_variable>
+#include <ctime>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+// Строки матриц дополнены нулями до кратного ROW_LANES: векторные циклы идут без хвоста
+constexpr int ROW_LANES = 8;
+
+// Все a[k] <= b[k] для строк длины n
+bool rowLessEqualScalar(const int* a, const int* b, int n) {
+    int over = 0;
+    for (int k = 0; k < n; ++k) over |= a[k] > b[k];
+    return !over;
+}
+
+void rowAddScalar(int* dst, const int* src, int n) {
+    for (int k = 0; k < n; ++k) dst[k] += src[k];
+}
+
+void rowSubScalar(int* dst, const int* src, int n) {
+    for (int k = 0; k < n; ++k) dst[k] -= src[k];
+}
+
+#if defined(__x86_64__)
+// AVX2: 8 ресурсов за сравнение; выход на первом блоке, где хоть одна полоса больше
+__attribute__((target("avx2")))
+bool rowLessEqualAvx2(const int* a, const int* b, int n) {
+    for (int k = 0; k < n; k += ROW_LANES) {
+        __m256i gt = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+        if (!_mm256_testz_si256(gt, gt)) return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+void rowAddAvx2(int* dst, const int* src, int n) {
+    for (int k = 0; k < n; k += ROW_LANES) {
+        __m256i* d = reinterpret_cast<__m256i*>(dst + k);
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k));
+        _mm256_storeu_si256(d, _mm256_add_epi32(_mm256_loadu_si256(d), s));
+    }
+}
+
+__attribute__((target("avx2")))
+void rowSubAvx2(int* dst, const int* src, int n) {
+    for (int k = 0; k < n; k += ROW_LANES) {
+        __m256i* d = reinterpret_cast<__m256i*>(dst + k);
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k));
+        _mm256_storeu_si256(d, _mm256_sub_epi32(_mm256_loadu_si256(d), s));
+    }
+}
+#endif
+
+// Операции над дополненными строками; набор выбирается один раз под процессор
+struct RowKernels {
+    bool (*lessEqual)(const int* a, const int* b, int n);
+    void (*add)(int* dst, const int* src, int n);
+    void (*sub)(int* dst, const int* src, int n);
+    const char* name;
+};
+
+const RowKernels& rowKernels() {
+    static const RowKernels kernels = []() -> RowKernels {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return {rowLessEqualAvx2, rowAddAvx2, rowSubAvx2, "avx2"};
+#endif
+        return {rowLessEqualScalar, rowAddScalar, rowSubScalar, "scalar"};
+    }();
+    return kernels;
+}
+
 // Алгоритм банкира для избежания deadlock'а
 class BankersAlgorithm {
 private:
     int num_processes;
     int num_resources;
+    int stride;                        // длина строки с дополнением до ROW_LANES
 
-    vector<vector<int>> max_need;      // максимум, что может потребоваться каждому процессу
-    vector<vector<int>> allocated;     // сколько выделено каждому процессу
+    // Матрицы хранятся строками процессов подряд, строка i начинается с i * stride
+    vector<int> max_need;              // максимум, что может потребоваться каждому процессу
+    vector<int> allocated;             // сколько выделено каждому процессу
+    vector<int> need;                  // max_need - allocated, обновляется вместе с allocated
     vector<int> available;             // сколько ресурсов свободно
 
     mutex banker_mutex;
 
-    // Проверка безопасности состояния
+    // Копия allocated для чтения без блокировки. Пишется под banker_mutex только там, где
+    // решение уже принято, поэтому пробные выдачи проверки безопасности в неё не попадают.
+    // Строку процесса охраняет свой счётчик версий (seqlock): нечётное значение — строка
+    // переписывается, читатель повторяет чтение.
+    unique_ptr<atomic<int>[]> allocated_view;
+    unique_ptr<atomic<unsigned>[]> view_version;
+
+    void publish(int process_id) {
+        atomic<unsigned>& version = view_version[process_id];
+        unsigned v = version.load(memory_order_relaxed);
+        version.store(v + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        const int* a = row(allocated, process_id);
+        atomic<int>* view = allocated_view.get() + static_cast<size_t>(process_id) * num_resources;
+        for (int j = 0; j < num_resources; ++j) view[j].store(a[j], memory_order_relaxed);
+        version.store(v + 2, memory_order_release);
+    }
+
+    // Для быстрой проверки безопасности: по каждому ресурсу процессы по возрастанию
+    // оставшейся потребности (вместе с ней, чтобы обход шёл подряд по памяти) и позиция
+    // каждого процесса в этом порядке. Порядок ресурса j занимает элементы [j * n, (j + 1) * n).
+    // Он поддерживается при каждом изменении allocated, а не сортируется заново.
+    struct OrderEntry {
+        int need;
+        int process;
+    };
+    vector<OrderEntry> by_need;
+    vector<int> order_pos;
+
+    // Рабочие массивы, чтобы не выделять память под мьютексом
+    vector<int> work;
+    vector<int> satisfied;
+    vector<int> ready;
+    vector<int> next_in_order;
+    vector<int> frontier;              // потребность следующего непокрытого процесса по ресурсу
+    vector<int> pending;               // запрос, дополненный нулями до stride
+
+    int* row(vector<int>& matrix, int i) { return matrix.data() + static_cast<size_t>(i) * stride; }
+    const int* row(const vector<int>& matrix, int i) const {
+        return matrix.data() + static_cast<size_t>(i) * stride;
+    }
+
+    // Копирует вектор из num_resources элементов в pending
+    const int* padded(const vector<int>& amounts) {
+        copy(amounts.begin(), amounts.begin() + num_resources, pending.begin());
+        return pending.data();
+    }
+
+    // Возвращает процесс p на место в порядке ресурса j после изменения его потребности
+    void reorder(int p, int j) {
+        OrderEntry* order = by_need.data() + static_cast<size_t>(j) * num_processes;
+        int* where = order_pos.data() + static_cast<size_t>(j) * num_processes;
+        const int v = row(need, p)[j];
+        int k = where[p];
+        while (k > 0 && order[k - 1].need > v) {
+            order[k] = order[k - 1];
+            where[order[k].process] = k;
+            --k;
+        }
+        while (k + 1 < num_processes && order[k + 1].need < v) {
+            order[k] = order[k + 1];
+            where[order[k].process] = k;
+            ++k;
+        }
+        order[k] = {v, p};
+        where[p] = k;
+    }
+
+    // Пересчитывает need и порядки из max_need и allocated
+    void rebuild() {
+        for (size_t k = 0; k < need.size(); ++k) need[k] = max_need[k] - allocated[k];
+        for (int j = 0; j < num_resources; ++j) {
+            OrderEntry* order = by_need.data() + static_cast<size_t>(j) * num_processes;
+            for (int i = 0; i < num_processes; ++i) order[i] = {row(need, i)[j], i};
+            stable_sort(order, order + num_processes,
+                        [](const OrderEntry& a, const OrderEntry& b) { return a.need < b.need; });
+            for (int k = 0; k < num_processes; ++k) {
+                order_pos[static_cast<size_t>(j) * num_processes + order[k].process] = k;
+            }
+        }
+        for (int i = 0; i < num_processes; ++i) publish(i);
+    }
+
+    // Проверка безопасности состояния за O(n·m). Для каждого процесса считается, по скольким
+    // ресурсам его потребность уже покрыта work; указатель по порядку ресурса j сдвигается,
+    // только когда растёт work[j]. Процесс, покрытый по всем ресурсам, завершается и
+    // возвращает выделенное. Порядок завершения не важен: work только растёт.
+    bool isSafeOrdered() {
+        if (num_resources == 0) return true;
+        const RowKernels& kernels = rowKernels();
+        work = available;
+        satisfied.assign(num_processes, 0);
+        next_in_order.assign(num_resources, 0);
+        ready.clear();
+
+        auto advance = [&](int j) {
+            const OrderEntry* order = by_need.data() + static_cast<size_t>(j) * num_processes;
+            int k = next_in_order[j];
+            while (k < num_processes && order[k].need <= work[j]) {
+                int i = order[k++].process;
+                if (++satisfied[i] == num_resources) ready.push_back(i);
+            }
+            next_in_order[j] = k;
+            frontier[j] = k < num_processes ? order[k].need : numeric_limits<int>::max();
+        };
+
+        for (int j = 0; j < num_resources; ++j) advance(j);
+        int finished = 0;
+        while (!ready.empty()) {
+            int i = ready.back();
+            ready.pop_back();
+            ++finished;
+            kernels.add(work.data(), row(allocated, i), stride);
+            // к порядкам ресурсов обращаемся, только если work дорос до следующего процесса
+            for (int j = 0; j < num_resources; ++j) {
+                if (work[j] >= frontier[j]) advance(j);
+            }
+        }
+        return finished == num_processes;
+    }
+
+    // Проверка проходами по строкам need: за проход завершаются все процессы, которых
+    // покрывает work, пока проход завершает хоть кого-то. Сравнение строки векторное и
+    // обрывается на первом непокрытом блоке, поэтому непокрытый процесс обычно стоит O(1),
+    // а не O(m), как в порядках isSafeOrdered.
+    bool isSafeScan() {
+        if (num_resources == 0) return true;
+        const RowKernels& kernels = rowKernels();
+        work = available;
+        satisfied.assign(num_processes, 0);  // здесь — признак завершения
+        int finished = 0;
+        for (bool progress = true; progress;) {
+            progress = false;
+            for (int i = 0; i < num_processes; ++i) {
+                const int* need_row = row(need, i);
+                // первый ресурс проверяется на месте, без вызова ядра: отсев обычно на нём
+                if (satisfied[i] || need_row[0] > work[0] || !kernels.lessEqual(need_row, work.data(), stride)) continue;
+                kernels.add(work.data(), row(allocated, i), stride);
+                satisfied[i] = 1;
+                ++finished;
+                progress = true;
+            }
+        }
+        return finished == num_processes;
+    }
+
+    // isSafeOrdered платит O(m) за каждый завершённый процесс и выигрывает, когда процессов
+    // много при узких строках; isSafeScan в худшем случае O(n²) сравнений и выигрывает при
+    // широких строках. Граница подобрана по замерам benchmarkSafetyCheck (--verify).
+    static constexpr int SCAN_PROCESSES_PER_RESOURCE = 2;
+
     bool isSafe() {
+        if (num_processes <= SCAN_PROCESSES_PER_RESOURCE * num_resources) return isSafeScan();
+        return isSafeOrdered();
+    }
+
+    // Исходная проверка: после каждого завершённого процесса поиск начинается с нулевого,
+    // O(n²·m). Оставлена скалярной как независимый эталон для verifySafetyCheck.
+    bool isSafeReference() {
         vector<int> work = available;
         vector<bool> finish(num_processes, false);
         int count = 0;
@@ -33,8 +273,7 @@ private:
 
                 bool can_finish = true;
                 for (int j = 0; j < num_resources; ++j) {
-                    int need = max_need[i][j] - allocated[i][j];
-                    if (work[j] < need) {
+                    if (work[j] < max_need[i * stride + j] - allocated[i * stride + j]) {
                         can_finish = false;
                         break;
                     }
@@ -42,7 +281,7 @@ private:
 
                 if (can_finish) {
                     for (int j = 0; j < num_resources; ++j) {
-                        work[j] += allocated[i][j];
+                        work[j] += allocated[i * stride + j];
                     }
                     finish[i] = true;
                     found = true;
@@ -57,76 +296,1293 @@ private:
         return true;
     }
 
+    // Проверяет запрос по need и available и применяет его; false — запрос не применён
+    bool applyRequest(int process_id, const int* req) {
+        const RowKernels& kernels = rowKernels();
+        if (!kernels.lessEqual(req, row(need, process_id), stride)) return false;
+        if (!kernels.lessEqual(req, available.data(), stride)) return false;
+
+        kernels.sub(available.data(), req, stride);
+        kernels.add(row(allocated, process_id), req, stride);
+        kernels.sub(row(need, process_id), req, stride);
+        for (int i = 0; i < num_resources; ++i) {
+            if (req[i]) reorder(process_id, i);
+        }
+        return true;
+    }
+
+    // Одиночный запрос под взятой блокировкой: применить и оставить, только если состояние
+    // безопасно. ticket — место блокирующего запроса в очереди; остальные идут как NO_TICKET
+    // (моложе всех ожидающих) и так же уступают старейшему.
+    bool grantLocked(int process_id, const vector<int>& request, uint64_t ticket = NO_TICKET) {
+        if (yieldsToOldest(process_id, ticket)) return false;
+        const int* req = padded(request);
+        if (!applyRequest(process_id, req)) return false;
+        if (isSafe()) {
+            publish(process_id);
+            noteGrant(ticket);
+            return true;
+        }
+
+        // Откат
+        rollbackRequest(process_id, req);
+        return false;
+    }
+
+    void rollbackRequest(int process_id, const int* req) {
+        const RowKernels& kernels = rowKernels();
+        kernels.add(available.data(), req, stride);
+        kernels.sub(row(allocated, process_id), req, stride);
+        kernels.add(row(need, process_id), req, stride);
+        for (int i = 0; i < num_resources; ++i) {
+            if (req[i]) reorder(process_id, i);
+        }
+    }
+
+    // Заявка пакетного допуска. Подаётся без блокировки. Узел заявки requestResourcesBatched
+    // лежит на стеке подающего, а строка запроса — в его потоковом буфере, так что на запрос
+    // ничего не выделяется; подающий ждёт, пока state не станет RELEASED. Заявку
+    // submitRequest выделяет подающий, а результат приходит через future; такой узел
+    // удаляет тот, кто выполнил обещание.
+    struct PendingRequest {
+        enum : int { WAITING, DECIDED, RELEASED };
+
+        int process_id;
+        const int* request;            // дополнена нулями до stride
+        bool ok = false;               // решение
+        PendingRequest* next = nullptr;
+        atomic<int> state{WAITING};
+        unique_ptr<promise<bool>> granted;  // только у заявок submitRequest
+        vector<int> row;                    // строка запроса заявки submitRequest
+    };
+
+    // Поданные заявки: стек Трайбера, в который пишут многие потоки, а забирает целиком
+    // тот, кто держит banker_mutex. Узлы по одному не снимаются, поэтому ABA не возникает.
+    atomic<PendingRequest*> submitted{nullptr};
+
+    // Поднят, пока кто-то из requestResourcesBatched разбирает очередь
+    atomic<bool> combining{false};
+
+    // Заявки текущей порции подряд, для двоичного поиска. Длиннее BATCH_CHUNK порция не
+    // бывает, так что память выделяется один раз в конструкторе.
+    static constexpr size_t BATCH_CHUNK = 256;
+    vector<PendingRequest*> batch_buffer;
+
+    void enqueue(PendingRequest* p) {
+        // seq_cst вместе с флагом combining: либо подавший сам станет разбирающим, либо
+        // разбирающий после снятия флага увидит его заявку
+        p->next = submitted.load(memory_order_relaxed);
+        while (!submitted.compare_exchange_weak(p->next, p, memory_order_seq_cst, memory_order_relaxed)) {
+        }
+    }
+
+    // Все поданные заявки списком в порядке подачи (список разворачивается на месте)
+    PendingRequest* takeSubmitted() {
+        PendingRequest* fifo = nullptr;
+        for (PendingRequest* p = submitted.exchange(nullptr, memory_order_acquire); p;) {
+            PendingRequest* next = p->next;
+            p->next = fifo;
+            fifo = p;
+            p = next;
+        }
+        return fifo;
+    }
+
+    // Сообщает решение подавшему. После RELEASED узел на стеке может исчезнуть, поэтому
+    // next читается заранее, а notify идёт до RELEASED: подавший, проснувшись на DECIDED,
+    // дожидается RELEASED, не засыпая.
+    static void complete(PendingRequest* p, bool ok) {
+        if (p->granted) {
+            p->granted->set_value(ok);
+            delete p;
+            return;
+        }
+        p->ok = ok;
+        p->state.store(PendingRequest::DECIDED, memory_order_release);
+        p->state.notify_one();
+        p->state.store(PendingRequest::RELEASED, memory_order_release);
+    }
+
+    // Решения по заявкам, те же, что дали бы requestResources по очереди, но с меньшим
+    // числом проверок безопасности. Выдача ресурсов не делает опасное состояние безопасным
+    // (безопасный порядок после выдачи годится и до неё), поэтому «префикс из L заявок
+    // безопасен» монотонно по L. Сначала применяются все подряд корректные заявки и
+    // проверяется одно состояние; если оно опасно, двоичным поиском находится самый
+    // длинный безопасный префикс, следующая за ним заявка отклоняется, а остальные
+    // рассматриваются заново. Проверок O(1 + d·log K) вместо K, где d — число отказов.
+    // Заявка, которая должна уступить старейшему ожидающему, отклоняется, как и в
+    // requestResources; выдачи, намеченные раньше неё в порции, уже считаются обгонами.
+    // Длинный список разбирается порциями по BATCH_CHUNK по порядку подачи.
+    void admitBatch(PendingRequest* head) {
+        vector<PendingRequest*>& batch = batch_buffer;
+        while (head) {
+            batch.clear();
+            for (; head && batch.size() < BATCH_CHUNK; head = head->next) batch.push_back(head);
+            admitChunk(batch);
+        }
+    }
+
+    void admitChunk(vector<PendingRequest*>& batch) {
+        int granted = 0;
+        size_t next = 0;
+        while (next < batch.size()) {
+            size_t applied = 0;
+            while (next + applied < batch.size() &&
+                   !yieldsToOldest(batch[next + applied]->process_id, NO_TICKET, granted + static_cast<int>(applied)) &&
+                   applyRequest(batch[next + applied]->process_id, batch[next + applied]->request)) {
+                ++applied;
+            }
+            if (applied == 0) {
+                ++next;  // запрос превышает need или available
+                continue;
+            }
+            if (isSafe()) {
+                for (size_t k = next; k < next + applied; ++k) batch[k]->ok = true;
+                granted += static_cast<int>(applied);
+                next += applied + 1;  // следующая, если есть, не прошла проверку в этом же состоянии
+                continue;
+            }
+
+            // префикс lo безопасен (или пуст), префикс hi опасен; применено current заявок
+            size_t lo = 0, hi = applied, current = applied;
+            auto setPrefix = [&](size_t len) {
+                for (; current > len; --current) {
+                    rollbackRequest(batch[next + current - 1]->process_id, batch[next + current - 1]->request);
+                }
+                for (; current < len; ++current) {
+                    applyRequest(batch[next + current]->process_id, batch[next + current]->request);
+                }
+            };
+            while (hi - lo > 1) {
+                size_t mid = (lo + hi) / 2;
+                setPrefix(mid);
+                (isSafe() ? lo : hi) = mid;
+            }
+            setPrefix(lo);
+            for (size_t k = next; k < next + lo; ++k) batch[k]->ok = true;
+            granted += static_cast<int>(lo);
+            next += lo + 1;
+        }
+        for (PendingRequest* p : batch) {
+            if (!p->ok) continue;
+            publish(p->process_id);
+            noteGrant(NO_TICKET);
+        }
+    }
+
+    // Обрабатывает поданные заявки под уже взятой блокировкой; решения сообщаются после
+    // её снятия, чтобы разбуженные потоки не упирались в мьютекс
+    size_t admitLocked(unique_lock<mutex>& lock) {
+        PendingRequest* head = takeSubmitted();
+        admitBatch(head);
+        lock.unlock();
+        size_t count = 0;
+        while (head) {
+            PendingRequest* p = head;
+            head = p->next;
+            complete(p, p->ok);
+            ++count;
+        }
+        return count;
+    }
+
+    struct Waiter;
+
+    // Звено интрузивного списка ожидающих: узел — сам Waiter на стеке ожидающего потока,
+    // поэтому постановка в очередь под banker_mutex ничего не выделяет
+    struct WaitLink {
+        Waiter* prev = nullptr;
+        Waiter* next = nullptr;
+    };
+
+    // Ожидающий запрос блокирующего API. Живёт на стеке ожидающего потока; решение
+    // принимает поток, освободивший ресурсы, и будит только его.
+    struct Waiter {
+        int process_id;
+        vector<int> request;           // дополнен нулями до stride
+        uint64_t ticket;               // порядок постановки в очередь
+        int queue = 0;                 // в какой из waiters стоит
+        int bypassed = 0;              // сколько раз его обогнали, пока он был старейшим
+        bool done = false;
+        bool granted = false;
+        condition_variable wake;
+        WaitLink in_queue;             // звено в waiters[queue]
+        WaitLink in_age;               // звено в by_age
+    };
+
+    template <WaitLink Waiter::*Link>
+    struct WaitList {
+        Waiter* head = nullptr;
+        Waiter* tail = nullptr;
+
+        bool empty() const { return !head; }
+
+        void pushBack(Waiter* w) {
+            (w->*Link).prev = tail;
+            (w->*Link).next = nullptr;
+            (tail ? (tail->*Link).next : head) = w;
+            tail = w;
+        }
+
+        void remove(Waiter* w) {
+            WaitLink& link = w->*Link;
+            (link.prev ? (link.prev->*Link).next : head) = link.next;
+            (link.next ? (link.next->*Link).prev : tail) = link.prev;
+        }
+    };
+
+    // Билет запросов не из блокирующего API: они моложе любого ожидающего
+    static constexpr uint64_t NO_TICKET = numeric_limits<uint64_t>::max();
+
+    // Старейшего ожидающего можно обогнать не больше MAX_BYPASS раз. После этого процессы,
+    // которые ничего не держат, ждут, пока его не обслужат. Процессы с выделенными ресурсами
+    // не задерживаются: старейший может ждать именно их освобождения.
+    static constexpr int MAX_BYPASS = 16;
+
+    // Полных проверок безопасности за один проход wakeWaiters, если в нём уже кому-то выдали.
+    // Остальных кандидатов рассмотрит следующее освобождение — его сделает и получивший.
+    // Проход без единой выдачи не ограничен, иначе ожидающих могло бы быть некому разбудить.
+    static constexpr int WAKE_SAFETY_CHECKS = 4;
+
+    // Очереди ожидания: waiters[j] — запросы, которым не хватает ресурса j (по первому
+    // такому ресурсу), waiters[num_resources] — запросы, которым хватает available, но
+    // выдача сделала бы состояние опасным, задержанные ради старейшего и не проверенные
+    // из-за WAKE_SAFETY_CHECKS.
+    vector<WaitList<&Waiter::in_queue>> waiters;
+    WaitList<&Waiter::in_age> by_age;   // все ожидающие по возрасту: билеты только растут
+    uint64_t next_ticket = 0;
+
+    // Кандидаты прохода wakeWaiters; память переиспользуется
+    vector<Waiter*> wake_candidates;
+
+    bool holdsNothing(int process_id) const {
+        const int* a = row(allocated, process_id);
+        return all_of(a, a + num_resources, [](int v) { return v == 0; });
+    }
+
+    // Процесс должен встать за старейшим ожидающим. pending_grants — выдачи, уже намеченные
+    // в текущем пакете, но ещё не учтённые в bypassed.
+    bool yieldsToOldest(int process_id, uint64_t ticket, int pending_grants = 0) const {
+        const Waiter* oldest = by_age.head;
+        return oldest && oldest->ticket != ticket && oldest->bypassed + pending_grants >= MAX_BYPASS &&
+               holdsNothing(process_id);
+    }
+
+    // Выдача запросу моложе старейшего ожидающего — обгон
+    void noteGrant(uint64_t ticket) {
+        if (by_age.head && by_age.head->ticket < ticket) ++by_age.head->bypassed;
+    }
+
+    // Выдача заведомо безопасна, если процесс может завершиться сразу: need ≤ available до
+    // неё. Завершившись, он вернёт всё, и остальным останется больше, чем в прежнем
+    // безопасном состоянии.
+    bool finishesNow(int process_id) const {
+        return rowKernels().lessEqual(row(need, process_id), available.data(), stride);
+    }
+
+    void park(Waiter& w) {
+        const int* req = w.request.data();
+        w.queue = num_resources;
+        for (int j = 0; j < num_resources; ++j) {
+            if (req[j] > available[j]) {
+                w.queue = j;
+                break;
+            }
+        }
+        waiters[w.queue].pushBack(&w);
+    }
+
+    void unpark(Waiter& w) {
+        waiters[w.queue].remove(&w);
+        by_age.remove(&w);
+    }
+
+    void finish(Waiter& w, bool granted) {
+        unpark(w);
+        w.done = true;
+        w.granted = granted;
+        w.wake.notify_one();
+    }
+
+    // После освобождения ресурсов released (nullptr — ничего не освобождено, но мог
+    // смениться старейший) проверяет только тех, кому они могли помочь: очереди освобождённых
+    // ресурсов и очередь опасных. Кандидаты рассматриваются от старых к новым. Если процессу
+    // после выдачи хватает available на всю оставшуюся потребность, выдача безопасна без
+    // проверки; иначе — полная проверка в пределах WAKE_SAFETY_CHECKS. Не получившие
+    // переставляются в очередь того ресурса, которого им теперь не хватает.
+    void wakeWaiters(const int* released) {
+        vector<Waiter*>& candidates = wake_candidates;
+        candidates.clear();
+        for (int j = 0; j <= num_resources; ++j) {
+            if (j < num_resources && (!released || !released[j])) continue;
+            for (Waiter* w = waiters[j].head; w; w = w->in_queue.next) candidates.push_back(w);
+        }
+        if (candidates.empty()) return;
+        sort(candidates.begin(), candidates.end(), [](const Waiter* a, const Waiter* b) { return a->ticket < b->ticket; });
+
+        const RowKernels& kernels = rowKernels();
+        int checks = 0;
+        bool any_granted = false;
+        for (Waiter* w : candidates) {
+            const int* req = w->request.data();
+            if (!kernels.lessEqual(req, row(need, w->process_id), stride)) {
+                finish(*w, false);  // тот же процесс успел получить своё другим запросом
+                continue;
+            }
+            if (!yieldsToOldest(w->process_id, w->ticket)) {
+                const bool safe_anyway = finishesNow(w->process_id);
+                const bool may_check = safe_anyway || !any_granted || checks < WAKE_SAFETY_CHECKS;
+                if (may_check && applyRequest(w->process_id, req)) {
+                    if (safe_anyway || (++checks, isSafe())) {
+                        publish(w->process_id);
+                        finish(*w, true);
+                        noteGrant(w->ticket);
+                        any_granted = true;
+                        continue;
+                    }
+                    rollbackRequest(w->process_id, req);
+                }
+            }
+            waiters[w->queue].remove(w);
+            park(*w);
+        }
+    }
+
+    friend bool verifySafetyCheck(int trials, mt19937& gen);
+    friend void benchmarkSafetyCheck(int n, int m, mt19937& gen);
+
 public:
-    BankersAlgorithm(int p, int r) : num_processes(p), num_resources(r) {
-        max_need.assign(p, vector<int>(r));
-        allocated.assign(p, vector<int>(r, 0));
-        available.assign(r, 0);
+    BankersAlgorithm(int p, int r)
+        : num_processes(p), num_resources(r), stride((r + ROW_LANES - 1) / ROW_LANES * ROW_LANES) {
+        max_need.assign(static_cast<size_t>(p) * stride, 0);
+        allocated.assign(static_cast<size_t>(p) * stride, 0);
+        need.assign(static_cast<size_t>(p) * stride, 0);
+        available.assign(stride, 0);
+        by_need.resize(static_cast<size_t>(r) * p);
+        order_pos.resize(static_cast<size_t>(r) * p);
+        pending.assign(stride, 0);
+        batch_buffer.reserve(BATCH_CHUNK);
+        frontier.assign(stride, numeric_limits<int>::max());
+        waiters.resize(r + 1);
+        wake_candidates.reserve(256);
+        allocated_view = make_unique<atomic<int>[]>(static_cast<size_t>(p) * r);
+        view_version = make_unique<atomic<unsigned>[]>(p);
+        rebuild();
     }
 
     // Инициализация системы
     void initialize(const vector<int>& total_resources, const vector<vector<int>>& max_needs) {
-        available = total_resources;
-        max_need = max_needs;
+        copy(total_resources.begin(), total_resources.begin() + num_resources, available.begin());
+        for (int i = 0; i < num_processes; ++i) {
+            copy(max_needs[i].begin(), max_needs[i].begin() + num_resources, row(max_need, i));
+        }
+        rebuild();
+    }
+
+    ~BankersAlgorithm() {
+        // заявки, которые никто не обработал, отклоняются
+        for (PendingRequest* p = takeSubmitted(); p;) {
+            PendingRequest* next = p->next;
+            complete(p, false);
+            p = next;
+        }
     }
 
     // Запрос ресурсов
     bool requestResources(int process_id, const vector<int>& request) {
         lock_guard<mutex> lock(banker_mutex);
+        return grantLocked(process_id, request);
+    }
 
-        for (int i = 0; i < num_resources; ++i) {
-            if (request[i] > max_need[process_id][i] - allocated[process_id][i]) return false;
-            if (request[i] > available[i]) return false;
-        }
-
-        for (int i = 0; i < num_resources; ++i) {
-            available[i] -= request[i];
-            allocated[process_id][i] += request[i];
-        }
+    // Подать запрос в очередь пакетного допуска без блокировки
+    future<bool> submitRequest(int process_id, const vector<int>& request) {
+        auto node = make_unique<PendingRequest>();
+        node->process_id = process_id;
+        node->row.assign(stride, 0);
+        copy(request.begin(), request.begin() + num_resources, node->row.begin());
+        node->request = node->row.data();
+        node->granted = make_unique<promise<bool>>();
+        future<bool> result = node->granted->get_future();
+        enqueue(node.release());
+        return result;
+    }
 
-        if (isSafe()) return true;
+    // Решить все поданные запросы за одну блокировку; возвращает их число
+    size_t admitPending() {
+        unique_lock<mutex> lock(banker_mutex);
+        return admitLocked(lock);
+    }
 
-        // Откат
-        for (int i = 0; i < num_resources; ++i) {
-            available[i] += request[i];
-            allocated[process_id][i] -= request[i];
+    // Запрос через очередь: очередь разбирает один поток — тот, кто поднял флаг combining, —
+    // пакетами, пока она не опустеет; остальные спят на своей заявке. Результат тот же,
+    // что у requestResources, если бы запросы пришли в порядке подачи. Без соперников
+    // запрос решается сразу, минуя очередь.
+    //
+    // Выигрыш — одна блокировка и одна проверка безопасности на пакет вместо каждой заявки.
+    // Он заметен, когда проверка безопасности дорогая (много процессов) и пакеты успевают
+    // набраться; при дешёвой проверке очередь стоит примерно столько же, сколько мьютекс
+    // (см. --bench).
+    bool requestResourcesBatched(int process_id, const vector<int>& request) {
+        {
+            unique_lock<mutex> lock(banker_mutex, try_to_lock);
+            if (lock.owns_lock() && !submitted.load(memory_order_acquire)) return grantLocked(process_id, request);
         }
-        return false;
+        thread_local vector<int> row;
+        row.assign(stride, 0);
+        copy(request.begin(), request.begin() + num_resources, row.begin());
+        PendingRequest node;
+        node.process_id = process_id;
+        node.request = row.data();
+        enqueue(&node);
+        while (!combining.exchange(true, memory_order_seq_cst)) {
+            unique_lock<mutex> lock(banker_mutex);
+            admitLocked(lock);
+            combining.store(false, memory_order_seq_cst);
+            // заявка, поданная, пока флаг был поднят, иначе осталась бы без разбирающего
+            if (!submitted.load(memory_order_seq_cst)) break;
+        }
+        node.state.wait(PendingRequest::WAITING, memory_order_acquire);
+        while (node.state.load(memory_order_acquire) != PendingRequest::RELEASED) this_thread::yield();
+        return node.ok;
     }
 
     // Освободить ресурсы
     void releaseResources(int process_id, const vector<int>& release) {
         lock_guard<mutex> lock(banker_mutex);
+        const RowKernels& kernels = rowKernels();
+        const int* rel = padded(release);
+        kernels.sub(row(allocated, process_id), rel, stride);
+        kernels.add(available.data(), rel, stride);
+        kernels.add(row(need, process_id), rel, stride);
         for (int i = 0; i < num_resources; ++i) {
-            allocated[process_id][i] -= release[i];
-            available[i] += release[i];
+            if (rel[i]) reorder(process_id, i);
         }
+        publish(process_id);
+        if (!by_age.empty()) wakeWaiters(rel);
     }
 
-    int getMaxNeed(int process_id, int resource_id) {
+    // Отдать до wanted свободных ресурсов так, чтобы состояние осталось безопасным: пробуется
+    // min(wanted, available), при опасном состоянии — вдвое меньше. Возвращает отданное.
+    vector<int> lendAvailable(const vector<int>& wanted) {
         lock_guard<mutex> lock(banker_mutex);
-        return max_need[process_id][resource_id];
+        const RowKernels& kernels = rowKernels();
+        vector<int> lent(stride, 0);
+        for (int j = 0; j < num_resources; ++j) lent[j] = max(0, min(wanted[j], available[j]));
+        while (any_of(lent.begin(), lent.end(), [](int v) { return v > 0; })) {
+            kernels.sub(available.data(), lent.data(), stride);
+            if (isSafe()) break;
+            kernels.add(available.data(), lent.data(), stride);
+            for (int& v : lent) v /= 2;
+        }
+        lent.resize(num_resources);
+        return lent;
     }
 
-    int getAllocated(int process_id, int resource_id) {
+    // Добавить свободных ресурсов (безопасность от этого не страдает) и разбудить ожидающих
+    void addAvailable(const vector<int>& amount) {
         lock_guard<mutex> lock(banker_mutex);
-        return allocated[process_id][resource_id];
+        const int* add = padded(amount);
+        rowKernels().add(available.data(), add, stride);
+        if (!by_age.empty()) wakeWaiters(add);
+    }
+
+    // Запрос с ожиданием: если выдать сейчас нельзя, поток ждёт в очереди, пока освобождения
+    // не сделают выдачу возможной. false — запрос превышает оставшуюся потребность процесса
+    // (его не выполнить никогда) или истёк timeout.
+    bool requestResourcesBlocking(int process_id, const vector<int>& request) {
+        return requestResourcesUntil(process_id, request, nullptr);
+    }
+
+    template <class Rep, class Period>
+    bool requestResourcesFor(int process_id, const vector<int>& request, chrono::duration<Rep, Period> timeout) {
+        auto deadline = chrono::steady_clock::now() + timeout;
+        return requestResourcesUntil(process_id, request, &deadline);
+    }
+
+    bool requestResourcesUntil(int process_id, const vector<int>& request,
+                               const chrono::steady_clock::time_point* deadline) {
+        // строка запроса готовится до блокировки, чтобы не выделять память под мьютексом
+        Waiter w;
+        w.process_id = process_id;
+        w.request.assign(stride, 0);
+        copy(request.begin(), request.begin() + num_resources, w.request.begin());
+
+        unique_lock<mutex> lock(banker_mutex);
+        if (!rowKernels().lessEqual(w.request.data(), row(need, process_id), stride)) return false;
+        w.ticket = next_ticket++;
+        if (grantLocked(process_id, request, w.ticket)) return true;
+
+        park(w);
+        by_age.pushBack(&w);
+        while (!w.done) {
+            if (!deadline) {
+                w.wake.wait(lock);
+            } else if (w.wake.wait_until(lock, *deadline) == cv_status::timeout && !w.done) {
+                bool was_oldest = by_age.head == &w;
+                unpark(w);
+                if (was_oldest) wakeWaiters(nullptr);  // задержанные ради него могут пройти
+                return false;
+            }
+        }
+        return w.granted;
+    }
+
+    int processCount() const { return num_processes; }
+
+    // max_need после initialize не меняется, читается без блокировки
+    int getMaxNeed(int process_id, int resource_id) const { return row(max_need, process_id)[resource_id]; }
+
+    // Без блокировки, по последнему принятому решению
+    int getAllocated(int process_id, int resource_id) const {
+        return allocated_view[static_cast<size_t>(process_id) * num_resources + resource_id].load(memory_order_relaxed);
+    }
+
+    // Согласованная строка allocated процесса без блокировки
+    vector<int> snapshotAllocated(int process_id) const {
+        vector<int> result(num_resources);
+        const atomic<unsigned>& version = view_version[process_id];
+        const atomic<int>* view = allocated_view.get() + static_cast<size_t>(process_id) * num_resources;
+        for (;;) {
+            unsigned before = version.load(memory_order_acquire);
+            if (before & 1) {
+                this_thread::yield();
+                continue;
+            }
+            for (int j = 0; j < num_resources; ++j) result[j] = view[j].load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (version.load(memory_order_relaxed) == before) return result;
+        }
     }
 
     void printState() {
         lock_guard<mutex> lock(banker_mutex);
         cout << "Available resources: ";
-        for (int r : available) cout << r << " ";
+        for (int j = 0; j < num_resources; ++j) cout << available[j] << " ";
         cout << "\nAllocated:\n";
         for (int i = 0; i < num_processes; ++i) {
             cout << "  Process " << i << ": ";
-            for (int j = 0; j < num_resources; ++j) cout << allocated[i][j] << " ";
+            for (int j = 0; j < num_resources; ++j) cout << row(allocated, i)[j] << " ";
             cout << "\n";
         }
     }
 };
 
-int main() {
+// Банкир, разбитый на независимые части. Ресурсы делятся на шарды — компоненты связности
+// графа «ресурсы связаны, если какому-то процессу нужны оба». Процессы разных шардов друг
+// другу не мешают, и состояние безопасно ровно тогда, когда безопасен каждый шард, так что
+// решения те же, что у одного BankersAlgorithm, но под разными мьютексами.
+//
+// Процессы шарда делятся на группы по group_size, у каждой свой BankersAlgorithm и свой
+// бюджет — доля ресурсов шарда. Если каждая группа безопасна в своём бюджете, безопасна и
+// вся система: безопасные порядки групп выполняются друг за другом. Это условие строже
+// точного, поэтому группа, которой не хватило бюджета, обращается к балансировщику шарда,
+// и тот переносит к ней свободные ресурсы других групп, сколько те могут отдать, оставаясь
+// безопасными. Отказ после этого возможен и там, где точный банкир выдал бы ресурсы.
+class ShardedBanker {
+private:
+    struct Shard {
+        vector<int> resources;                          // глобальные номера ресурсов шарда
+        vector<unique_ptr<BankersAlgorithm>> groups;
+        mutex rebalance_mutex;                          // один балансировщик на шард
+    };
+
+    // Где живёт процесс; shard == -1 — процессу ничего не нужно
+    struct Placement {
+        int shard = -1;
+        int group = 0;
+        int local = 0;
+    };
+
+    int num_processes;
+    int num_resources;
+    int group_size;
+    vector<unique_ptr<Shard>> shards;
+    vector<int> resource_shard;                         // шард ресурса
+    vector<int> resource_local;                         // номер ресурса внутри шарда
+    vector<Placement> placement;
+    atomic<long long> rebalances{0};
+
+    // Переводит вектор по всем ресурсам в вектор ресурсов шарда процесса; false — в нём есть
+    // ресурс другого шарда, то есть больше потребности процесса
+    bool localize(const Placement& at, const vector<int>& amounts, vector<int>& local) const {
+        local.assign(at.shard < 0 ? 0 : shards[at.shard]->resources.size(), 0);
+        for (int j = 0; j < num_resources; ++j) {
+            if (!amounts[j]) continue;
+            if (resource_shard[j] != at.shard) return false;
+            local[resource_local[j]] = amounts[j];
+        }
+        return true;
+    }
+
+    // Собрать для группы недостающее у остальных групп шарда; false — ничего не нашлось
+    bool rebalance(const Placement& at, const vector<int>& wanted) {
+        Shard& shard = *shards[at.shard];
+        if (shard.groups.size() < 2) return false;
+        lock_guard<mutex> lock(shard.rebalance_mutex);
+        vector<int> rest = wanted, moved(wanted.size(), 0);
+        for (size_t k = 1; k < shard.groups.size(); ++k) {
+            vector<int> lent = shard.groups[(at.group + k) % shard.groups.size()]->lendAvailable(rest);
+            bool more = false;
+            for (size_t j = 0; j < rest.size(); ++j) {
+                moved[j] += lent[j];
+                rest[j] -= lent[j];
+                more |= rest[j] > 0;
+            }
+            if (!more) break;
+        }
+        if (all_of(moved.begin(), moved.end(), [](int v) { return v == 0; })) return false;
+        shard.groups[at.group]->addAvailable(moved);
+        ++rebalances;
+        return true;
+    }
+
+public:
+    ShardedBanker(int p, int r, int group_size = 64) : num_processes(p), num_resources(r), group_size(group_size) {}
+
+    // Инициализация: разбиение на шарды и группы по max_needs, бюджеты групп — доли запаса,
+    // пропорциональные суммарной максимальной потребности группы
+    void initialize(const vector<int>& total_resources, const vector<vector<int>>& max_needs) {
+        vector<int> parent(num_resources);
+        for (int j = 0; j < num_resources; ++j) parent[j] = j;
+        auto find = [&parent](int j) {
+            while (parent[j] != j) j = parent[j] = parent[parent[j]];
+            return j;
+        };
+        for (const auto& needs : max_needs) {
+            int first = -1;
+            for (int j = 0; j < num_resources; ++j) {
+                if (!needs[j]) continue;
+                if (first < 0) first = find(j);
+                else parent[find(j)] = first;
+            }
+        }
+
+        shards.clear();
+        resource_shard.assign(num_resources, -1);
+        resource_local.assign(num_resources, 0);
+        vector<int> root_shard(num_resources, -1);
+        for (int j = 0; j < num_resources; ++j) {
+            int& id = root_shard[find(j)];
+            if (id < 0) {
+                id = static_cast<int>(shards.size());
+                shards.push_back(make_unique<Shard>());
+            }
+            resource_shard[j] = id;
+            resource_local[j] = static_cast<int>(shards[id]->resources.size());
+            shards[id]->resources.push_back(j);
+        }
+
+        vector<vector<int>> members(shards.size());
+        placement.assign(num_processes, Placement{});
+        for (int i = 0; i < num_processes; ++i) {
+            for (int j = 0; j < num_resources; ++j) {
+                if (max_needs[i][j]) {
+                    placement[i].shard = resource_shard[j];
+                    break;
+                }
+            }
+            if (placement[i].shard < 0) continue;
+            vector<int>& list = members[placement[i].shard];
+            placement[i].group = static_cast<int>(list.size()) / group_size;
+            placement[i].local = static_cast<int>(list.size()) % group_size;
+            list.push_back(i);
+        }
+
+        for (size_t s = 0; s < shards.size(); ++s) {
+            const vector<int>& resources = shards[s]->resources;
+            const int r = static_cast<int>(resources.size());
+            const size_t count = (members[s].size() + group_size - 1) / group_size;
+            vector<vector<vector<int>>> needs(count);
+            vector<vector<long long>> demand(count, vector<long long>(r, 0));
+            vector<long long> demand_total(r, 0);
+            for (int i : members[s]) {
+                vector<int> local;
+                localize(placement[i], max_needs[i], local);
+                for (int k = 0; k < r; ++k) {
+                    demand[placement[i].group][k] += local[k];
+                    demand_total[k] += local[k];
+                }
+                needs[placement[i].group].push_back(move(local));
+            }
+
+            vector<vector<int>> budgets(count, vector<int>(r, 0));
+            for (int k = 0; k < r; ++k) {
+                const int total = total_resources[resources[k]];
+                int left = total;
+                for (size_t g = 0; g < count; ++g) {
+                    budgets[g][k] = static_cast<int>(total * demand[g][k] / max(demand_total[k], 1LL));
+                    left -= budgets[g][k];
+                }
+                for (size_t g = 0; count && left > 0; g = (g + 1) % count, --left) ++budgets[g][k];
+            }
+            for (size_t g = 0; g < count; ++g) {
+                auto banker = make_unique<BankersAlgorithm>(static_cast<int>(needs[g].size()), r);
+                banker->initialize(budgets[g], needs[g]);
+                shards[s]->groups.push_back(move(banker));
+            }
+        }
+    }
+
+    bool requestResources(int process_id, const vector<int>& request) {
+        const Placement& at = placement[process_id];
+        vector<int> local;
+        if (!localize(at, request, local)) return false;
+        if (at.shard < 0) return true;  // пустой запрос процесса без потребностей
+        BankersAlgorithm& group = *shards[at.shard]->groups[at.group];
+        if (group.requestResources(at.local, local)) return true;
+
+        // запрос сверх потребности не выполнить никаким бюджетом
+        const int r = static_cast<int>(local.size());
+        for (int k = 0; k < r; ++k) {
+            if (local[k] > group.getMaxNeed(at.local, k) - group.getAllocated(at.local, k)) return false;
+        }
+        // кроме самого запроса, просим запас на завершение самого требовательного процесса
+        // группы: отказ чаще всего из-за того, что после выдачи никому не хватит завершиться
+        vector<int> wanted = local;
+        for (int k = 0; k < r; ++k) {
+            int largest = 0;
+            for (int i = 0; i < group.processCount(); ++i) {
+                largest = max(largest, group.getMaxNeed(i, k) - group.getAllocated(i, k));
+            }
+            wanted[k] += largest;
+        }
+        return rebalance(at, wanted) && group.requestResources(at.local, local);
+    }
+
+    void releaseResources(int process_id, const vector<int>& release) {
+        const Placement& at = placement[process_id];
+        vector<int> local;
+        if (!localize(at, release, local) || at.shard < 0) return;
+        shards[at.shard]->groups[at.group]->releaseResources(at.local, local);
+    }
+
+    int getMaxNeed(int process_id, int resource_id) const {
+        const Placement& at = placement[process_id];
+        if (at.shard < 0 || resource_shard[resource_id] != at.shard) return 0;
+        return shards[at.shard]->groups[at.group]->getMaxNeed(at.local, resource_local[resource_id]);
+    }
+
+    int getAllocated(int process_id, int resource_id) const {
+        const Placement& at = placement[process_id];
+        if (at.shard < 0 || resource_shard[resource_id] != at.shard) return 0;
+        return shards[at.shard]->groups[at.group]->getAllocated(at.local, resource_local[resource_id]);
+    }
+
+    size_t shardCount() const { return shards.size(); }
+
+    size_t groupCount() const {
+        size_t count = 0;
+        for (const auto& shard : shards) count += shard->groups.size();
+        return count;
+    }
+
+    long long rebalanceCount() const { return rebalances.load(); }
+};
+
+// Сверка быстрой проверки безопасности с эталонной на случайных состояниях, в том числе
+// небезопасных, и после случайных запросов и освобождений, которые двигают порядки по потребности
+bool verifySafetyCheck(int trials, mt19937& gen) {
+    auto random = [&gen](int lo, int hi) { return uniform_int_distribution<>(lo, hi)(gen); };
+    int safe_states = 0, checks = 0;
+
+    for (int t = 0; t < trials; ++t) {
+        int n = random(1, 40), m = random(1, 20);
+        BankersAlgorithm banker(n, m);
+        vector<vector<int>> max_needs(n, vector<int>(m));
+        for (auto& row : max_needs) for (int& v : row) v = random(0, 9);
+        banker.initialize(vector<int>(m, 0), max_needs);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < m; ++j) banker.row(banker.allocated, i)[j] = random(0, max_needs[i][j]);
+        }
+        for (int j = 0; j < m; ++j) banker.available[j] = random(0, 6);
+        banker.rebuild();
+
+        for (int op = 0; op <= 20; ++op) {
+            if (op > 0) {
+                int pid = random(0, n - 1);
+                vector<int> amounts(m);
+                bool release = random(0, 2) == 0;
+                for (int j = 0; j < m; ++j) {
+                    int limit = (release ? banker.row(banker.allocated, pid) : banker.row(banker.need, pid))[j];
+                    amounts[j] = random(0, limit);
+                }
+                if (release) banker.releaseResources(pid, amounts);
+                else banker.requestResources(pid, amounts);
+            }
+            bool ordered = banker.isSafeOrdered(), scan = banker.isSafeScan();
+            bool reference = banker.isSafeReference();
+            ++checks;
+            safe_states += reference;
+            if (ordered != reference || scan != reference) {
+                cout << "MISMATCH: ordered=" << ordered << " scan=" << scan << " reference=" << reference << " (trial " << t
+                     << ", " << n << " processes, " << m << " resources)\n";
+                banker.printState();
+                return false;
+            }
+        }
+    }
+    cout << "Safety check matches reference on " << checks << " states (" << safe_states << " safe)\n";
+    return true;
+}
+
+// Время проверки безопасного состояния, в котором процессы могут завершиться только
+// в одном порядке — худший случай для поиска с нулевого процесса
+void benchmarkSafetyCheck(int n, int m, mt19937& gen) {
+    auto random = [&gen](int lo, int hi) { return uniform_int_distribution<>(lo, hi)(gen); };
+    BankersAlgorithm banker(n, m);
+    vector<int> work(m, 1);
+    // процесс n-1 завершается первым, 0 — последним; каждому нужна ровно накопленная work
+    for (int i = n - 1; i >= 0; --i) {
+        int* allocated = banker.row(banker.allocated, i);
+        for (int j = 0; j < m; ++j) {
+            allocated[j] = random(1, 3);
+            banker.row(banker.max_need, i)[j] = allocated[j] + work[j];
+        }
+        for (int j = 0; j < m; ++j) work[j] += allocated[j];
+    }
+    fill(banker.available.begin(), banker.available.begin() + m, 1);
+    banker.rebuild();
+
+    auto time = [&](auto&& check) {
+        int reps = 0;
+        bool safe = true;
+        auto start = chrono::high_resolution_clock::now();
+        auto elapsed = chrono::nanoseconds(0);
+        while (elapsed < chrono::milliseconds(200)) {
+            safe = safe && check();
+            ++reps;
+            elapsed = chrono::high_resolution_clock::now() - start;
+        }
+        return make_pair(elapsed.count() / 1000.0 / reps, safe);
+    };
+    auto [ordered_us, ordered_safe] = time([&] { return banker.isSafeOrdered(); });
+    auto [scan_us, scan_safe] = time([&] { return banker.isSafeScan(); });
+    auto [reference_us, reference_safe] = time([&] { return banker.isSafeReference(); });
+    bool scan_chosen = n <= BankersAlgorithm::SCAN_PROCESSES_PER_RESOURCE * m;
+    cout << fixed << setprecision(1) << n << " processes x " << m << " resources: "
+         << "reference " << reference_us << " us, ordered " << ordered_us << " us, scan " << scan_us << " us"
+         << " -> isSafe uses " << (scan_chosen ? "scan" : "ordered")
+         << ((scan_chosen ? scan_us : ordered_us) > reference_us ? " (SLOWER THAN REFERENCE)" : "")
+         << (ordered_safe && scan_safe && reference_safe ? "" : " (UNEXPECTED UNSAFE)") << "\n";
+}
+
+// Пакетный допуск должен решить заявки так же, как requestResources в порядке подачи
+bool verifyBatchAdmission(int trials, mt19937& gen) {
+    auto random = [&gen](int lo, int hi) { return uniform_int_distribution<>(lo, hi)(gen); };
+    size_t requests = 0, granted = 0;
+
+    for (int t = 0; t < trials; ++t) {
+        int n = random(1, 30), m = random(1, 12);
+        vector<vector<int>> max_needs(n, vector<int>(m));
+        for (auto& row : max_needs) for (int& v : row) v = random(0, 9);
+        vector<int> total(m);
+        for (int& v : total) v = random(5, 5 + 3 * n);
+        BankersAlgorithm sequential(n, m), batched(n, m);
+        sequential.initialize(total, max_needs);
+        batched.initialize(total, max_needs);
+
+        // общее начальное состояние: одни и те же ранее выданные запросы
+        for (int k = 0; k < n; ++k) {
+            int pid = random(0, n - 1);
+            vector<int> request(m);
+            for (int j = 0; j < m; ++j) request[j] = random(0, max_needs[pid][j] / 2);
+            sequential.requestResources(pid, request);
+            batched.requestResources(pid, request);
+        }
+
+        vector<pair<int, vector<int>>> pending(random(1, 60));
+        vector<future<bool>> results;
+        for (auto& [pid, request] : pending) {
+            pid = random(0, n - 1);
+            request.resize(m);
+            for (int& v : request) v = random(0, 1) * random(0, 3);
+            results.push_back(batched.submitRequest(pid, request));
+        }
+        batched.admitPending();
+
+        for (size_t k = 0; k < pending.size(); ++k) {
+            bool expected = sequential.requestResources(pending[k].first, pending[k].second);
+            bool got = results[k].get();
+            ++requests;
+            granted += got;
+            if (expected != got) {
+                cout << "BATCH MISMATCH: request " << k << " of " << pending.size() << " expected " << expected
+                     << " got " << got << " (trial " << t << ")\n";
+                return false;
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < m; ++j) {
+                if (sequential.getAllocated(i, j) != batched.getAllocated(i, j)) {
+                    cout << "BATCH MISMATCH: final allocation differs (trial " << t << ")\n";
+                    return false;
+                }
+            }
+        }
+    }
+    cout << "Batch admission matches sequential on " << requests << " requests (" << granted << " granted)\n";
+    return true;
+}
+
+// Пропускная способность допуска: каждый поток — свой процесс, запрашивает одну-две единицы
+// случайного ресурса и сразу освобождает выданное. Остальные из processes процессов ничего
+// не делают, но их строки проходит каждая проверка безопасности.
+void benchmarkAdmission(int threads, int processes, int m, int ops_per_thread, bool batched) {
+    BankersAlgorithm banker(processes, m);
+    mt19937 setup(threads);
+    vector<vector<int>> max_needs(processes, vector<int>(m));
+    for (auto& row : max_needs) for (int& v : row) v = uniform_int_distribution<>(1, 8)(setup);
+    // запаса хватает, чтобы любой процесс мог завершиться: начальное состояние безопасно
+    banker.initialize(vector<int>(m, 8 + threads), max_needs);
+
+    atomic<long long> granted{0};
+    vector<thread> workers;
+    auto start = chrono::high_resolution_clock::now();
+    for (int pid = 0; pid < threads; ++pid) {
+        workers.emplace_back([&, pid]() {
+            mt19937 gen(pid);
+            vector<int> request(m, 0);
+            long long mine = 0;
+            for (int op = 0; op < ops_per_thread; ++op) {
+                int j = gen() % m;
+                request[j] = 1 + gen() % 2;
+                bool ok = batched ? banker.requestResourcesBatched(pid, request) : banker.requestResources(pid, request);
+                if (ok) {
+                    banker.releaseResources(pid, request);
+                    ++mine;
+                }
+                request[j] = 0;
+            }
+            granted += mine;
+        });
+    }
+    for (auto& t : workers) t.join();
+    double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    long long total = static_cast<long long>(threads) * ops_per_thread;
+    cout << setw(7) << threads << " threads  " << setw(5) << processes << " processes  "
+         << setw(8) << (batched ? "batched" : "mutex") << fixed
+         << setprecision(0) << setw(12) << total / seconds << " req/s  granted " << setprecision(1)
+         << 100.0 * granted / total << "%\n";
+}
+
+// Блокирующие запросы: процессы берут потребность частями и ждут, пока выдача станет
+// возможной. В безопасном состоянии все они должны дождаться выдачи (без потерянных
+// пробуждений), а по окончании система — вернуться к исходному запасу.
+bool verifyBlocking(int trials, mt19937& gen) {
+    auto random = [&gen](int lo, int hi) { return uniform_int_distribution<>(lo, hi)(gen); };
+    long long waits = 0;
+
+    for (int t = 0; t < trials; ++t) {
+        int n = random(2, 12), m = random(1, 6);
+        vector<vector<int>> max_needs(n, vector<int>(m));
+        vector<int> total(m, 0);
+        for (auto& row : max_needs) {
+            for (int j = 0; j < m; ++j) {
+                row[j] = random(0, 6);
+                total[j] = max(total[j], row[j]);
+            }
+        }
+        for (int& v : total) v += random(0, 4);
+        BankersAlgorithm banker(n, m);
+        banker.initialize(total, max_needs);
+
+        atomic<bool> failed{false};
+        vector<thread> workers;
+        for (int pid = 0; pid < n; ++pid) {
+            workers.emplace_back([&, pid, seed = static_cast<unsigned>(gen())]() {
+                mt19937 local(seed);
+                for (int round = 0; round < 3; ++round) {
+                    vector<int> held(m, 0);
+                    for (int part = 0; part < 3; ++part) {
+                        vector<int> request(m);
+                        for (int j = 0; j < m; ++j) {
+                            int rest = max_needs[pid][j] - held[j];
+                            request[j] = part == 2 ? rest : uniform_int_distribution<>(0, rest)(local);
+                        }
+                        // нечётные процессы повторяют неблокирующий запрос: старейший
+                        // ожидающий должен дождаться своего и среди них
+                        bool granted = false;
+                        if (pid % 2 == 0) {
+                            granted = banker.requestResourcesFor(pid, request, chrono::seconds(10));
+                        } else {
+                            auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+                            while (!(granted = banker.requestResources(pid, request)) &&
+                                   chrono::steady_clock::now() < deadline) {
+                                this_thread::yield();
+                            }
+                        }
+                        if (!granted) {
+                            failed = true;
+                            return;
+                        }
+                        for (int j = 0; j < m; ++j) held[j] += request[j];
+                    }
+                    banker.releaseResources(pid, held);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        waits += 9LL * n;
+        if (failed) {
+            cout << "BLOCKING FAILURE: a request timed out (trial " << t << ")\n";
+            return false;
+        }
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < m; ++j) {
+                if (banker.getAllocated(i, j) != 0) {
+                    cout << "BLOCKING FAILURE: resources left allocated (trial " << t << ")\n";
+                    return false;
+                }
+            }
+        }
+    }
+    cout << "Blocking requests: " << waits << " requests in " << trials << " systems, all granted (half of the processes retrying)\n";
+    return true;
+}
+
+// Повтор против ожидания при нехватке ресурсов: каждый поток — свой процесс, берёт всю
+// свою потребность, недолго держит и освобождает. Запаса хватает примерно на пятую часть потоков.
+void benchmarkBlocking(int threads, chrono::milliseconds duration, bool blocking) {
+    const int m = 4;
+    BankersAlgorithm banker(threads, m);
+    mt19937 setup(threads);
+    vector<vector<int>> max_needs(threads, vector<int>(m));
+    for (auto& row : max_needs) for (int& v : row) v = uniform_int_distribution<>(1, 4)(setup);
+    banker.initialize(vector<int>(m, max(4, threads / 2)), max_needs);
+
+    atomic<bool> stop{false};
+    atomic<long long> retries{0};
+    vector<vector<double>> waits_us(threads);
+    vector<thread> workers;
+    clock_t cpu_start = clock();
+    auto start = chrono::steady_clock::now();
+    for (int pid = 0; pid < threads; ++pid) {
+        workers.emplace_back([&, pid]() {
+            const vector<int>& request = max_needs[pid];
+            long long mine = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                auto asked = chrono::steady_clock::now();
+                if (blocking) {
+                    banker.requestResourcesBlocking(pid, request);
+                } else {
+                    while (!banker.requestResources(pid, request)) {
+                        ++mine;
+                        this_thread::yield();
+                    }
+                }
+                auto got = chrono::steady_clock::now();
+                waits_us[pid].push_back(chrono::duration<double, micro>(got - asked).count());
+                this_thread::sleep_for(chrono::microseconds(100));  // работа с ресурсами, поток уступает CPU
+                banker.releaseResources(pid, request);
+            }
+            retries += mine;
+        });
+    }
+    this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& t : workers) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double cpu = double(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    vector<double> all;
+    size_t fewest = numeric_limits<size_t>::max();
+    for (auto& w : waits_us) {
+        all.insert(all.end(), w.begin(), w.end());
+        fewest = min(fewest, w.size());
+    }
+    sort(all.begin(), all.end());
+    double p99 = all.empty() ? 0 : all[min(all.size() - 1, all.size() * 99 / 100)];
+    cout << setw(7) << threads << " threads  " << setw(8) << (blocking ? "blocking" : "retry") << fixed
+         << setprecision(0) << setw(10) << all.size() / seconds << " grants/s  cpu " << setprecision(2)
+         << cpu / seconds << " cores  retries/grant " << setprecision(1)
+         << (all.empty() ? 0.0 : double(retries) / all.size()) << "  p99 wait " << setprecision(0) << p99
+         << " us  max " << (all.empty() ? 0 : all.back()) << " us  fewest grants/thread " << fewest << "\n";
+}
+
+// Шардированный банкир против одного BankersAlgorithm на случайных операциях. Ресурсы собраны
+// в кластеры, потребности процесса не выходят за свой кластер, кроме редких процессов,
+// связывающих два кластера. Без деления на группы решения должны совпадать; с группами
+// каждая выдача должна быть допустима и для точного банкира.
+bool verifySharded(int trials, mt19937& gen) {
+    auto random = [&gen](int lo, int hi) { return uniform_int_distribution<>(lo, hi)(gen); };
+    long long requests[2] = {0, 0}, granted[2] = {0, 0};
+    size_t shards = 0;
+
+    for (int t = 0; t < trials; ++t) {
+        int clusters = random(1, 6), width = random(1, 4), m = clusters * width, n = random(1, 40);
+        vector<vector<int>> max_needs(n, vector<int>(m, 0));
+        for (auto& row : max_needs) {
+            int c = random(0, clusters - 1);
+            for (int k = 0; k < width; ++k) row[c * width + k] = random(0, 5);
+            if (random(0, 19) == 0) row[random(0, m - 1)] = random(1, 3);
+        }
+        // начальное состояние безопасно: иначе один банкир отказывает во всём, а шарды — только
+        // в опасных шардах
+        vector<int> total(m, 0);
+        for (int j = 0; j < m; ++j) {
+            for (const auto& row : max_needs) total[j] = max(total[j], row[j]);
+            total[j] += random(0, 6);
+        }
+
+        for (int grouped = 0; grouped < 2; ++grouped) {
+            ShardedBanker sharded(n, m, grouped ? 4 : n);
+            BankersAlgorithm reference(n, m);
+            sharded.initialize(total, max_needs);
+            reference.initialize(total, max_needs);
+            if (!grouped) shards += sharded.shardCount();
+
+            for (int op = 0; op < 200; ++op) {
+                int pid = random(0, n - 1);
+                bool release = random(0, 2) == 0;
+                vector<int> amounts(m);
+                for (int j = 0; j < m; ++j) {
+                    int held = reference.getAllocated(pid, j);
+                    amounts[j] = random(0, 1) * random(0, release ? held : max_needs[pid][j] - held);
+                }
+                if (release) {
+                    sharded.releaseResources(pid, amounts);
+                    reference.releaseResources(pid, amounts);
+                    continue;
+                }
+                bool got = sharded.requestResources(pid, amounts);
+                ++requests[grouped];
+                granted[grouped] += got;
+                if (grouped ? got && !reference.requestResources(pid, amounts)
+                            : got != reference.requestResources(pid, amounts)) {
+                    cout << "SHARDED MISMATCH: " << (grouped ? "grouped" : "sharded") << " banker "
+                         << (got ? "granted" : "denied") << " request of process " << pid << " (trial " << t << ")\n";
+                    return false;
+                }
+            }
+            for (int i = 0; i < n; ++i) {
+                for (int j = 0; j < m; ++j) {
+                    if (sharded.getAllocated(i, j) != reference.getAllocated(i, j)) {
+                        cout << "SHARDED MISMATCH: final allocation differs (trial " << t << ")\n";
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    cout << "Sharded banker matches single banker on " << requests[0] << " requests (" << granted[0]
+         << " granted, " << shards << " shards in " << trials << " systems)\n"
+         << "Grouped banker stays safe on " << requests[1] << " requests (" << granted[1] << " granted)\n";
+    return true;
+}
+
+// Нагрузка тысяч клиентских потоков: каждый поток — свой процесс из одного из 16 кластеров
+// по 4 ресурса, запрашивает единицу нужного ресурса и сразу освобождает выданное.
+// Задержка — время вызова requestResources, включая ожидание мьютекса.
+template <class Banker>
+void benchmarkContention(const char* name, Banker& banker, const vector<vector<int>>& max_needs, int ops_per_thread) {
+    const int threads = static_cast<int>(max_needs.size());
+    const int m = static_cast<int>(max_needs[0].size());
+    atomic<long long> granted{0};
+    vector<vector<double>> latency_us(threads);
+    promise<void> go;
+    shared_future<void> start_signal = go.get_future().share();
+    vector<thread> workers;
+    for (int pid = 0; pid < threads; ++pid) {
+        workers.emplace_back([&, pid]() {
+            mt19937 gen(pid);
+            vector<int> needed, request(m, 0);
+            for (int j = 0; j < m; ++j) {
+                if (max_needs[pid][j]) needed.push_back(j);
+            }
+            latency_us[pid].reserve(ops_per_thread);
+            long long mine = 0;
+            start_signal.wait();
+            for (int op = 0; op < ops_per_thread; ++op) {
+                int j = needed[gen() % needed.size()];
+                request[j] = 1;
+                auto asked = chrono::steady_clock::now();
+                bool ok = banker.requestResources(pid, request);
+                latency_us[pid].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - asked).count());
+                if (ok) {
+                    banker.releaseResources(pid, request);
+                    ++mine;
+                }
+                request[j] = 0;
+            }
+            granted += mine;
+        });
+    }
+    auto start = chrono::steady_clock::now();
+    go.set_value();
+    for (auto& t : workers) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    for (auto& l : latency_us) all.insert(all.end(), l.begin(), l.end());
+    sort(all.begin(), all.end());
+    long long total = static_cast<long long>(threads) * ops_per_thread;
+    cout << setw(7) << threads << " threads  " << setw(8) << name << fixed << setprecision(0) << setw(10)
+         << total / seconds << " req/s  granted " << setprecision(1) << 100.0 * granted / total << "%  p50 "
+         << setprecision(0) << all[all.size() / 2] << " us  p99 " << all[all.size() * 99 / 100] << " us\n";
+}
+
+void benchmarkContention(int threads, int ops_per_thread) {
+    const int clusters = 16, width = 4, m = clusters * width;
+    mt19937 setup(threads);
+    vector<vector<int>> max_needs(threads, vector<int>(m, 0));
+    for (int pid = 0; pid < threads; ++pid) {
+        for (int k = 0; k < width; ++k) max_needs[pid][pid % clusters * width + k] = uniform_int_distribution<>(1, 3)(setup);
+    }
+    // запаса на восьмую часть суммарной потребности кластера: бюджетов групп не хватает,
+    // и балансировщику есть что делать
+    vector<int> total(m, max(3, threads / clusters / 4));
+
+    BankersAlgorithm single(threads, m);
+    single.initialize(total, max_needs);
+    benchmarkContention("mutex", single, max_needs, ops_per_thread);
+
+    ShardedBanker sharded(threads, m, threads);
+    sharded.initialize(total, max_needs);
+    benchmarkContention("sharded", sharded, max_needs, ops_per_thread);
+
+    ShardedBanker grouped(threads, m, 16);
+    grouped.initialize(total, max_needs);
+    benchmarkContention("grouped", grouped, max_needs, ops_per_thread);
+    cout << "         " << sharded.shardCount() << " shards, " << grouped.groupCount() << " groups, "
+         << grouped.rebalanceCount() << " rebalances\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--verify") {
+        int trials = argc > 2 ? stoi(argv[2]) : 2000;
+        mt19937 gen(12345);
+        if (!verifySafetyCheck(trials, gen)) return 1;
+        if (!verifyBatchAdmission(trials / 4, gen)) return 1;
+        if (!verifyBlocking(trials / 20, gen)) return 1;
+        if (!verifySharded(trials / 4, gen)) return 1;
+        cout << "Row kernels: " << rowKernels().name << "\n";
+        for (int m : {8, 64, 256}) {
+            for (int n : {100, 1000, 4000}) benchmarkSafetyCheck(n, m, gen);
+        }
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        vector<int> thread_counts = {1, 4, 16, 64};
+        if (argc > 2) thread_counts = {stoi(argv[2])};
+        for (int threads : thread_counts) {
+            for (bool batched : {false, true}) benchmarkAdmission(threads, threads, 32, 200000 / threads, batched);
+        }
+        // дорогая проверка безопасности: пакет экономит её, а не только блокировку
+        for (int threads : thread_counts) {
+            for (bool batched : {false, true}) benchmarkAdmission(threads, 2000, 32, 20000 / threads, batched);
+        }
+        for (int threads : thread_counts) {
+            for (bool blocking : {false, true}) benchmarkBlocking(threads, chrono::milliseconds(500), blocking);
+        }
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--contention") {
+        vector<int> thread_counts = {1000, 4000};
+        if (argc > 2) thread_counts = {stoi(argv[2])};
+        for (int threads : thread_counts) benchmarkContention(threads, max(2, 20000 / threads));
+        return 0;
+    }
+
     cout << "BANKER'S ALGORITHM\nDeadlock avoidance algorithm\n\n";
 
     int num_processes = 5;
@@ -157,8 +1613,9 @@ int main() {
 
             for (int req = 0; req < 3; ++req) {
                 vector<int> request(num_resources);
+                vector<int> held = banker.snapshotAllocated(pid);
                 for (int j = 0; j < num_resources; ++j) {
-                    int need = banker.getMaxNeed(pid, j) - banker.getAllocated(pid, j);
+                    int need = banker.getMaxNeed(pid, j) - held[j];
                     if (need > 0) {
                         uniform_int_distribution<> dis(0, need);
                         request[j] = dis(gen);
@@ -170,13 +1627,13 @@ int main() {
                 cout << "Process " << pid << " requests: ";
                 for (int r : request) cout << r << " ";
 
-                if (banker.requestResources(pid, request)) {
+                if (banker.requestResourcesFor(pid, request, chrono::milliseconds(500))) {
                     cout << " -> GRANTED\n";
                     this_thread::sleep_for(chrono::milliseconds(50));
                     banker.releaseResources(pid, request);
                     cout << "Process " << pid << " releases resources\n";
                 } else {
-                    cout << " -> DENIED (deadlock risk)\n";
+                    cout << " -> DENIED (timed out)\n";
                 }
             }
         });
@@ -0,0 +1,287 @@
+#pragma once
+
+// Топология процессора и закрепление потоков за ядрами.
+// Читает /sys/devices/system/cpu и /sys/devices/system/node, без libnuma.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+struct CpuInfo {
+    int cpu;      // номер логического процессора
+    int core;     // физическое ядро (core_id внутри сокета)
+    int package;  // сокет
+    int node;     // NUMA-узел
+    int smt;      // порядковый номер среди SMT-соседей ядра
+};
+
+// Политики размещения потоков:
+//   none         — не закреплять, решает планировщик
+//   compact      — заполнять ядро за ядром, SMT-соседей подряд, сокет за сокетом
+//   scatter      — по очереди в разные сокеты и ядра, SMT-соседи в последнюю очередь
+//   one-per-core — только первый логический процессор каждого ядра
+//   smt-pairs    — пары потоков на SMT-соседях, пары разносятся по сокетам
+enum class PinPolicy { NONE, COMPACT, SCATTER, ONE_PER_CORE, SMT_PAIRS };
+
+inline bool parsePinPolicy(const std::string& s, PinPolicy& policy) {
+    static const std::map<std::string, PinPolicy> names = {
+        {"none", PinPolicy::NONE}, {"compact", PinPolicy::COMPACT}, {"scatter", PinPolicy::SCATTER},
+        {"one-per-core", PinPolicy::ONE_PER_CORE}, {"smt-pairs", PinPolicy::SMT_PAIRS}};
+    auto it = names.find(s);
+    if (it == names.end()) return false;
+    policy = it->second;
+    return true;
+}
+
+inline std::string pinPolicyName(PinPolicy policy) {
+    switch (policy) {
+    case PinPolicy::COMPACT: return "compact";
+    case PinPolicy::SCATTER: return "scatter";
+    case PinPolicy::ONE_PER_CORE: return "one-per-core";
+    case PinPolicy::SMT_PAIRS: return "smt-pairs";
+    default: return "none";
+    }
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<int> parseCpuList(const std::string& s) {
+    std::vector<int> cpus;
+    std::stringstream ss(s);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int c = first; c <= last; ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+inline bool readSysfsInt(const std::string& path, int& value) {
+    std::ifstream in(path);
+    return static_cast<bool>(in >> value);
+}
+
+// Процессоры, на которых процессу разрешено работать (sched_getaffinity): внутри cpuset
+// или после taskset это подмножество online, и закрепление на остальных не удастся
+inline std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    for (int size = 1024; size <= (1 << 16); size *= 2) {
+        cpu_set_t* set = CPU_ALLOC(size);
+        if (!set) break;
+        size_t bytes = CPU_ALLOC_SIZE(size);
+        CPU_ZERO_S(bytes, set);
+        if (sched_getaffinity(0, bytes, set) == 0) {
+            for (int c = 0; c < size; ++c) {
+                if (CPU_ISSET_S(c, bytes, set)) cpus.push_back(c);
+            }
+            CPU_FREE(set);
+            break;
+        }
+        CPU_FREE(set);
+        if (errno != EINVAL) break;  // EINVAL — маска меньше числа процессоров в системе
+    }
+    return cpus;
+}
+
+class Topology {
+    std::vector<CpuInfo> cpus_;
+    int nodes_ = 1;
+    int packages_ = 1;
+
+public:
+    static Topology detect() {
+        Topology t;
+        std::string list;
+        std::vector<int> ids = allowedCpus();
+        if (ids.empty()) {
+            std::ifstream online("/sys/devices/system/cpu/online");
+            std::getline(online, list);
+            try {
+                ids = parseCpuList(list);
+            } catch (const std::exception&) {
+                ids.clear();
+            }
+        }
+        if (ids.empty()) {
+            // sysfs недоступен: считаем каждый логический процессор отдельным ядром
+            for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c) {
+                ids.push_back(static_cast<int>(c));
+            }
+        }
+
+        // Номера узлов могут идти с пропусками (0, 2, ...), поэтому перебирается список online
+        std::map<int, int> node_of;
+        std::vector<int> nodes;
+        std::ifstream nodes_online("/sys/devices/system/node/online");
+        if (std::getline(nodes_online, list)) {
+            try {
+                nodes = parseCpuList(list);
+            } catch (const std::exception&) {
+                nodes.clear();
+            }
+        }
+        for (int node : nodes) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!in || !std::getline(in, list)) continue;
+            try {
+                for (int c : parseCpuList(list)) node_of[c] = node;
+            } catch (const std::exception&) {
+                continue;
+            }
+        }
+        t.nodes_ = std::max<int>(1, static_cast<int>(nodes.size()));
+
+        for (int c : ids) {
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(c) + "/topology/";
+            CpuInfo info{c, c, 0, 0, 0};
+            readSysfsInt(base + "core_id", info.core);
+            readSysfsInt(base + "physical_package_id", info.package);
+            info.package = std::max(info.package, 0);
+            auto it = node_of.find(c);
+            if (it != node_of.end()) info.node = it->second;
+            t.cpus_.push_back(info);
+        }
+
+        // Номер SMT-соседа — порядок логического процессора внутри своего ядра
+        std::sort(t.cpus_.begin(), t.cpus_.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            return std::tie(a.package, a.core, a.cpu) < std::tie(b.package, b.core, b.cpu);
+        });
+        for (size_t i = 1; i < t.cpus_.size(); ++i) {
+            const CpuInfo& prev = t.cpus_[i - 1];
+            CpuInfo& cur = t.cpus_[i];
+            if (cur.package == prev.package && cur.core == prev.core) cur.smt = prev.smt + 1;
+        }
+        for (const auto& c : t.cpus_) t.packages_ = std::max(t.packages_, c.package + 1);
+        return t;
+    }
+
+    const std::vector<CpuInfo>& cpus() const { return cpus_; }
+    int nodes() const { return nodes_; }
+    int packages() const { return packages_; }
+
+    int nodeOf(int cpu) const {
+        for (const auto& c : cpus_) {
+            if (c.cpu == cpu) return c.node;
+        }
+        return 0;
+    }
+
+    std::string describe() const {
+        int cores = static_cast<int>(std::count_if(cpus_.begin(), cpus_.end(),
+                                                   [](const CpuInfo& c) { return c.smt == 0; }));
+        return std::to_string(cpus_.size()) + " cpus, " + std::to_string(cores) + " cores, " +
+               std::to_string(packages_) + " packages, " + std::to_string(nodes_) + " numa nodes";
+    }
+
+    // Порядок логических процессоров для политики; потоку i достаётся order[i % size]
+    std::vector<int> order(PinPolicy policy) const {
+        std::vector<CpuInfo> sorted = cpus_;
+        auto by = [&](auto key) {
+            std::stable_sort(sorted.begin(), sorted.end(),
+                             [&](const CpuInfo& a, const CpuInfo& b) { return key(a) < key(b); });
+        };
+
+        // Ранг ядра внутри сокета, чтобы ядра разных сокетов можно было чередовать
+        std::map<std::pair<int, int>, int> core_rank;
+        for (const auto& c : cpus_) {
+            auto key = std::make_pair(c.package, c.core);
+            if (!core_rank.count(key)) {
+                int rank = 0;
+                for (const auto& [k, r] : core_rank) rank += k.first == c.package;
+                core_rank[key] = rank;
+            }
+        }
+        auto rank = [&](const CpuInfo& c) { return core_rank.at({c.package, c.core}); };
+
+        switch (policy) {
+        case PinPolicy::NONE:
+            return {};
+        case PinPolicy::COMPACT:
+            by([&](const CpuInfo& c) { return std::make_tuple(c.package, rank(c), c.smt); });
+            break;
+        case PinPolicy::SCATTER:
+            by([&](const CpuInfo& c) { return std::make_tuple(c.smt, rank(c), c.package); });
+            break;
+        case PinPolicy::ONE_PER_CORE:
+            sorted.erase(std::remove_if(sorted.begin(), sorted.end(), [](const CpuInfo& c) { return c.smt != 0; }),
+                         sorted.end());
+            by([&](const CpuInfo& c) { return std::make_tuple(c.package, rank(c)); });
+            break;
+        case PinPolicy::SMT_PAIRS:
+            by([&](const CpuInfo& c) { return std::make_tuple(rank(c), c.package, c.smt); });
+            break;
+        }
+
+        std::vector<int> ids;
+        for (const auto& c : sorted) ids.push_back(c.cpu);
+        return ids;
+    }
+};
+
+// Закреплённые процессоры для threads потоков (пусто при PinPolicy::NONE)
+inline std::vector<int> planPlacement(const Topology& topology, PinPolicy policy, int threads) {
+    std::vector<int> order = topology.order(policy);
+    if (order.empty()) return {};
+    std::vector<int> plan(threads);
+    for (int i = 0; i < threads; ++i) plan[i] = order[i % order.size()];
+    return plan;
+}
+
+// "compact:0,1,2,3" или "none" — пишется в отчёты рядом с результатами. failed — сколько
+// потоков закрепить не удалось: они работали там, где решил планировщик, а не по плану.
+inline std::string describePlacement(PinPolicy policy, const std::vector<int>& plan, int failed = 0) {
+    std::string s = pinPolicyName(policy);
+    for (size_t i = 0; i < plan.size(); ++i) s += (i ? "," : ":") + std::to_string(plan[i]);
+    if (failed) s += " (pin failed: " + std::to_string(failed) + " threads)";
+    return s;
+}
+
+// Маска выделяется под номер процессора: allowedCpus возвращает и номера за CPU_SETSIZE
+inline bool pinThread(pthread_t thread, int cpu) {
+    if (cpu < 0) return false;
+    cpu_set_t* set = CPU_ALLOC(cpu + 1);
+    if (!set) return false;
+    size_t bytes = CPU_ALLOC_SIZE(cpu + 1);
+    CPU_ZERO_S(bytes, set);
+    CPU_SET_S(cpu, bytes, set);
+    bool ok = pthread_setaffinity_np(thread, bytes, set) == 0;
+    CPU_FREE(set);
+    return ok;
+}
+
+inline bool pinCurrentThread(int cpu) { return pinThread(pthread_self(), cpu); }
+
+// Привязывает страницы диапазона к NUMA-узлу и переносит уже размещённые (mbind, MPOL_BIND).
+// Частичные страницы по краям не трогаются. Без NUMA ядро вернёт ошибку — это не страшно,
+// данные просто останутся там, где их разместило первое касание.
+inline bool bindToNode(const void* data, size_t bytes, int node) {
+#ifdef SYS_mbind
+    constexpr int MPOL_BIND_POLICY = 2;
+    constexpr unsigned MPOL_MF_MOVE_PAGES = 1u << 1;
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) & ~(page - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(page - 1);
+    if (end <= begin || node < 0 || node >= 64) return false;
+    unsigned long mask = 1ul << node;
+    return syscall(SYS_mbind, begin, end - begin, MPOL_BIND_POLICY, &mask, 64, MPOL_MF_MOVE_PAGES) == 0;
+#else
+    (void)data;
+    (void)bytes;
+    (void)node;
+    return false;
+#endif
+}
@@ -2,335 +2,2125 @@
 #include <iomanip>
 #include <vector>
 #include <queue>
+#include <string>
+#include <sstream>
 #include <algorithm>
 #include <numeric>
 #include <chrono>
-#include <random>
+#include <functional>
+#include <memory>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <set>
+#include <ctime>
 
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
 #include <semaphore>
 #include <barrier>
 #include <atomic>
 #include <condition_variable>
 
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../Common/topology.hpp"
+
 using namespace std;
+using Clock = chrono::steady_clock;
+
+// Сборка с -DRACE_LATENCY включает замеры ожидания и удержания каждой блокировки.
+// Без флага пробы — пустые классы с пустыми inline-методами.
+#ifdef RACE_LATENCY
+constexpr bool LATENCY_PROBES = true;
+#else
+constexpr bool LATENCY_PROBES = false;
+#endif
 
-constexpr int THREADS = 7;        // Default number of threads
-constexpr int ITERATIONS = 10000;  // Default iterations per thread
+// Работа вне критической секции, которую потоки выполняют между операциями
+struct WorkSpec {
+    static constexpr int MAX_CHARS = 4096;  // размер буфера OutsideWork
 
-string randomChars(size_t len) {
-    static thread_local mt19937 gen(random_device{}());
-    uniform_int_distribution<> dis(32, 126);
+    enum Kind { NONE, CHARS, SPIN } kind = CHARS;
+    int amount = 5;  // CHARS — сколько символов сгенерировать, SPIN — сколько наносекунд крутиться
 
-    string s;
-    s.reserve(len);
-    for (int i = 0; i < len; ++i) {
-        s += static_cast<char>(dis(gen));
+    string describe() const {
+        if (kind == NONE) return "none";
+        return (kind == CHARS ? "chars:" : "spin:") + to_string(amount);
     }
-    return s;
-}
+};
 
-void printStats(const vector<size_t>& times) {
-    size_t total = accumulate(times.begin(), times.end(), 0LL);
-    size_t avg = total / times.size();
-    size_t minTime = *min_element(times.begin(), times.end());
-    size_t maxTime = *max_element(times.begin(), times.end());
-    
-    cout << "Avg: " << avg << " ms | Min: " << minTime << " ms | Max: " << maxTime << " ms\n";
-}
+// Параметры запуска (задаются аргументами командной строки)
+struct BenchConfig {
+    vector<int> threads;       // перебираемое количество потоков
+    vector<int> iterations;    // перебираемое количество итераций на поток
+    int warmup = 2;            // прогревочные прогоны, в статистику не входят
+    int repetitions = 10;      // измеряемые прогоны
+    vector<string> tests;      // фильтр по именам тестов (пусто — все)
+    string json_path;          // куда сохранить результаты в JSON
+    string csv_path;           // куда сохранить результаты в CSV
+    string baseline_path;      // CSV предыдущего запуска для сравнения
+    double threshold_pct = 10; // допустимое ухудшение медианы относительно baseline
+    vector<pair<int, int>> pc_ratios = {{1, 1}};  // соотношения производителей и потребителей
+    vector<int> batches = {1};                    // размеры пакетов push/pop
+    vector<pair<int, int>> rw_ratios = {{99, 1}, {90, 10}, {50, 50}};  // доли чтений и записей
+    int queue_capacity = 1024;
+    WorkSpec work;
+    PinPolicy pin = PinPolicy::NONE;
+};
+
+// Параметры одного прогона
+struct RunConfig {
+    int threads = 0;       // сколько потоков реально запускается
+    int iterations = 0;
+    string variant = {};   // подпись варианта сценария (пусто — единственный вариант)
+    int producers = 0;
+    int consumers = 0;
+    int batch = 1;
+    int queue_capacity = 1024;
+    int read_weight = 0;   // на read_weight чтений приходится write_weight записей
+    int write_weight = 0;
+    WorkSpec work = {};
+};
+
+// Результат одного прогона
+struct RunSample {
+    vector<size_t> thread_ns;  // время работы каждого потока
+    size_t wall_ns = 0;        // от общего старта до завершения последнего потока
+    size_t ops = 0;            // количество выполненных операций
+    long long count = -1;      // итоговое значение счётчика, должно совпасть с ops (-1 — не проверяется)
+    vector<pair<string, double>> metrics;  // дополнительные метрики сценария
+    string placement;                      // политика и процессоры потоков
+};
 
 struct TestResult {
     string name;
-    size_t avg_time;
+    string variant;
+    int threads;
+    int iterations;
+    size_t median_ns;
+    size_t p95_ns;
+    size_t p99_ns;
+    double ops_per_sec;
+    double fairness;           // min/max времени потоков: 1.0 — все закончили одновременно
+    vector<size_t> thread_ns;  // время потоков в медианном прогоне
+    bool count_ok;             // во всех прогонах счётчик совпал с числом операций
+    vector<pair<string, double>> metrics;
+    string placement;
+    string work;               // работа вне критической секции, WorkSpec::describe()
 };
 
+string displayName(const TestResult& r) {
+    return r.variant.empty() ? r.name : r.name + " [" + r.variant + "]";
+}
+
 vector<TestResult> all_results;
 
+// wyrand: быстрый 64-битный генератор, состояние — одно слово
+class WyRand {
+    uint64_t state;
+public:
+    explicit WyRand(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        state += 0xa0761d6478bd642fULL;
+        __uint128_t m = static_cast<__uint128_t>(state ^ 0xe7037ed1a0b428dbULL) * state;
+        return static_cast<uint64_t>(m >> 64) ^ static_cast<uint64_t>(m);
+    }
+};
+
+// Заполняет dst печатными ASCII-символами (32..126) без выделения памяти.
+// Случайный байт b отображается в 32 + b * 95 / 256, на SSE2 — по 16 байт за раз.
+void fillPrintable(char* dst, size_t len, WyRand& rng) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi16(95);
+    const __m128i base = _mm_set1_epi16(32);
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_set_epi64x(static_cast<long long>(rng.next()), static_cast<long long>(rng.next()));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        lo = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(lo, scale), 8), base);
+        hi = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(hi, scale), 8), base);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    while (i < len) {
+        uint64_t bits = rng.next();
+        for (int k = 0; k < 8 && i < len; ++k, ++i, bits >>= 8) {
+            dst[i] = static_cast<char>(32 + ((bits & 0xFF) * 95 >> 8));
+        }
+    }
+}
+
+// Итераций холостого цикла на наносекунду, измеряется один раз при старте
+double spin_iters_per_ns = 1.0;
+
+inline uint64_t spinIterations(uint64_t iterations, uint64_t x) {
+    for (uint64_t k = 0; k < iterations; ++k) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        asm volatile("" : "+r"(x));
+    }
+    return x;
+}
+
+void calibrateSpin() {
+    constexpr uint64_t CALIBRATION_ITERATIONS = 20'000'000;
+    spinIterations(CALIBRATION_ITERATIONS / 10, 1);  // прогрев
+    auto start = Clock::now();
+    spinIterations(CALIBRATION_ITERATIONS, 1);
+    double ns = chrono::duration<double, nano>(Clock::now() - start).count();
+    spin_iters_per_ns = CALIBRATION_ITERATIONS / max(ns, 1.0);
+}
+
+// Работа вне критической секции для одного потока: генерирует символы в собственный
+// буфер или крутится заданное время. В цикле бенчмарка ничего не выделяет.
+class OutsideWork {
+    WorkSpec spec;
+    WyRand rng;
+    uint64_t spin_iterations;
+    uint64_t sink = 0;
+    alignas(64) char buffer[WorkSpec::MAX_CHARS];
+public:
+    OutsideWork(const WorkSpec& spec, int thread_id)
+        : spec(spec), rng(0x9E3779B97F4A7C15ULL * (thread_id + 1)),
+          spin_iterations(static_cast<uint64_t>(spec.amount * spin_iters_per_ns)) {}
+
+    void run() {
+        switch (spec.kind) {
+        case WorkSpec::CHARS:
+            fillPrintable(buffer, spec.amount, rng);
+            asm volatile("" : : "r"(buffer) : "memory");  // результат считается использованным
+            break;
+        case WorkSpec::SPIN:
+            sink = spinIterations(spin_iterations, sink);
+            break;
+        case WorkSpec::NONE:
+            break;
+        }
+    }
+};
+
+Topology topology;
+PinPolicy pin_policy = PinPolicy::NONE;
+
+size_t elapsedNs(Clock::time_point start) {
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// Запускает body(i) в threads потоках. Потоки закрепляются по pin_policy и стартуют
+// одновременно по общему сигналу, on_start вызывается в главном потоке сразу после сигнала.
+// Состояние, которое поток создаёт сам после закрепления, по первому касанию попадает
+// в память его NUMA-узла.
+RunSample runThreads(int threads, const function<void(int)>& body,
+                     const function<void()>& on_start = {}) {
+    RunSample sample;
+    sample.thread_ns.assign(threads, 0);
+    vector<int> plan = planPlacement(topology, pin_policy, threads);
+    atomic<bool> go{false};
+    atomic<int> pin_failures{0};
+    vector<thread> workers;
+    workers.reserve(threads);
+
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() {
+            if (!plan.empty() && !pinCurrentThread(plan[i])) pin_failures.fetch_add(1, memory_order_relaxed);
+            go.wait(false, memory_order_acquire);
+            auto start = Clock::now();
+            body(i);
+            sample.thread_ns[i] = elapsedNs(start);
+        });
+    }
+
+    auto start = Clock::now();
+    go.store(true, memory_order_release);
+    go.notify_all();
+    if (on_start) on_start();
+
+    for (auto& t : workers) t.join();
+    sample.wall_ns = elapsedNs(start);
+    sample.placement = describePlacement(pin_policy, plan, pin_failures.load());
+    if (pin_failures.load()) {
+        static bool warned = false;
+        if (!warned) cerr << "Warning: thread pinning failed, placement " << sample.placement << "\n";
+        warned = true;
+    }
+    return sample;
+}
+
+// Перцентиль методом ближайшего ранга, values отсортирован
+size_t percentile(const vector<size_t>& values, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * values.size() + 0.999999);
+    return values[min(values.size(), max<size_t>(rank, 1)) - 1];
+}
+
+void printStats(const TestResult& r, const RunSample& median_run) {
+    auto [minIt, maxIt] = minmax_element(median_run.thread_ns.begin(), median_run.thread_ns.end());
+    if (!r.variant.empty()) cout << "  [" << r.variant << "]\n";
+    cout << "  T=" << setw(3) << r.threads << " I=" << setw(7) << r.iterations
+         << " | Median: " << setw(12) << r.median_ns << " ns"
+         << " | P95: " << setw(12) << r.p95_ns << " ns"
+         << " | P99: " << setw(12) << r.p99_ns << " ns"
+         << " | " << fixed << setprecision(0) << setw(12) << r.ops_per_sec << " ops/s"
+         << " | Thread min/max: " << *minIt << "/" << *maxIt << " ns"
+         << " | Fairness: " << setprecision(2) << r.fairness;
+    for (const auto& [key, value] : r.metrics) cout << " | " << key << ": " << value;
+    cout << "\n";
+}
+
+double fairness(const vector<size_t>& thread_ns) {
+    auto [minIt, maxIt] = minmax_element(thread_ns.begin(), thread_ns.end());
+    return *maxIt ? static_cast<double>(*minIt) / *maxIt : 1.0;
+}
+
+// Подсказка процессору, что поток крутится в ожидании
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Ожидание без блокировки: сначала pause, потом уступаем квант,
+// чтобы при переподписке не крутиться весь квант впустую
+class Backoff {
+    int spins = 0;
+public:
+    void operator()() {
+        if (++spins < 64) cpuRelax();
+        else this_thread::yield();
+    }
+    void reset() { spins = 0; }
+};
+
+// Семейство блокировок с общим интерфейсом lock(node)/unlock(node).
+// Node — состояние, которое поток держит на время захвата (нужно очередным блокировкам),
+// у простых блокировок оно пустое.
+
+// Test-and-test-and-set: ждём чтением, пишем только когда лок свободен,
+// после неудачного захвата — экспоненциальная пауза
+class TTASBackoffLock {
+    alignas(64) atomic<bool> locked{false};
+    static constexpr int MAX_BACKOFF = 1024;
+public:
+    static constexpr const char* NAME = "TTAS_BACKOFF";
+    struct Node {};
+
+    void lock(Node&) {
+        int backoff = 1;
+        for (;;) {
+            while (locked.load(memory_order_relaxed)) cpuRelax();
+            if (!locked.exchange(true, memory_order_acquire)) return;
+            for (int i = 0; i < backoff; ++i) cpuRelax();
+            backoff = min(backoff * 2, MAX_BACKOFF);
+        }
+    }
+
+    void unlock(Node&) {
+        locked.store(false, memory_order_release);
+    }
+};
+
+// Билетный лок: FIFO-порядок, пауза пропорциональна месту в очереди
+class TicketLock {
+    alignas(64) atomic<uint32_t> next_ticket{0};
+    alignas(64) atomic<uint32_t> now_serving{0};
+public:
+    static constexpr const char* NAME = "TICKET";
+    struct Node {};
+
+    void lock(Node&) {
+        uint32_t my = next_ticket.fetch_add(1, memory_order_relaxed);
+        for (;;) {
+            uint32_t serving = now_serving.load(memory_order_acquire);
+            if (serving == my) return;
+            for (uint32_t i = 0; i < (my - serving) * 16; ++i) cpuRelax();
+        }
+    }
+
+    void unlock(Node&) {
+        now_serving.store(now_serving.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+};
+
+// MCS: каждый поток крутится на флаге в собственном узле, владелец передаёт лок преемнику
+class MCSLock {
+public:
+    struct Node {
+        alignas(64) atomic<Node*> next{nullptr};
+        atomic<bool> locked{false};
+    };
+private:
+    alignas(64) atomic<Node*> tail{nullptr};
+public:
+    static constexpr const char* NAME = "MCS";
+
+    void lock(Node& node) {
+        node.next.store(nullptr, memory_order_relaxed);
+        node.locked.store(true, memory_order_relaxed);
+        Node* pred = tail.exchange(&node, memory_order_acq_rel);
+        if (!pred) return;
+
+        pred->next.store(&node, memory_order_release);
+        while (node.locked.load(memory_order_acquire)) cpuRelax();
+    }
+
+    void unlock(Node& node) {
+        Node* succ = node.next.load(memory_order_acquire);
+        if (!succ) {
+            Node* expected = &node;
+            if (tail.compare_exchange_strong(expected, nullptr, memory_order_acq_rel)) return;
+            // Преемник уже встал в хвост, но ещё не связал себя с нами
+            while (!(succ = node.next.load(memory_order_acquire))) cpuRelax();
+        }
+        succ->locked.store(false, memory_order_release);
+    }
+};
+
+// CLH: поток крутится на узле предшественника и после освобождения забирает его себе.
+// Узлов всегда на один больше, чем потоков: лишний принадлежит хвосту очереди.
+class CLHLock {
+    struct QNode {
+        alignas(64) atomic<bool> locked{false};
+    };
+    alignas(64) atomic<QNode*> tail{new QNode};
+public:
+    static constexpr const char* NAME = "CLH";
+
+    struct Node {
+        QNode* mine = new QNode;
+        QNode* pred = nullptr;
+
+        Node() = default;
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+        ~Node() { delete mine; }
+    };
+
+    ~CLHLock() { delete tail.load(); }
+
+    void lock(Node& node) {
+        node.mine->locked.store(true, memory_order_relaxed);
+        node.pred = tail.exchange(node.mine, memory_order_acq_rel);
+        while (node.pred->locked.load(memory_order_acquire)) cpuRelax();
+    }
+
+    void unlock(Node& node) {
+        node.mine->locked.store(false, memory_order_release);
+        node.mine = node.pred;
+    }
+};
+
+// Гибрид: короткий спин, затем засыпание на atomic::wait.
+// state: 0 — свободен, 1 — захвачен, 2 — захвачен и есть спящие
+class SpinThenParkLock {
+    alignas(64) atomic<int> state{0};
+    static constexpr int SPIN_LIMIT = 128;
+public:
+    static constexpr const char* NAME = "SPIN_THEN_PARK";
+    struct Node {};
+
+    void lock(Node&) {
+        for (int i = 0; i < SPIN_LIMIT; ++i) {
+            int expected = 0;
+            if (state.load(memory_order_relaxed) == 0 &&
+                state.compare_exchange_weak(expected, 1, memory_order_acquire)) {
+                return;
+            }
+            cpuRelax();
+        }
+        while (state.exchange(2, memory_order_acquire) != 0) {
+            state.wait(2, memory_order_relaxed);
+        }
+    }
+
+    void unlock(Node&) {
+        if (state.exchange(0, memory_order_release) == 2) state.notify_one();
+    }
+};
+
+// Лог-линейная гистограмма в духе HDR: значения до 2^SUB_BITS хранятся точно,
+// дальше каждая степень двойки делится на 2^SUB_BITS равных корзин (ошибка ~3%)
+class LogLinearHistogram {
+    static constexpr int SUB_BITS = 5;
+    static constexpr uint64_t SUB = 1ull << SUB_BITS;
+    vector<uint64_t> counts = vector<uint64_t>((64 - SUB_BITS + 1) * SUB, 0);
+    uint64_t total = 0;
+    uint64_t max_value = 0;
+
+    static size_t indexOf(uint64_t v) {
+        int msb = 63 - __builtin_clzll(v | 1);
+        if (msb < SUB_BITS) return v;
+        int shift = msb - SUB_BITS;
+        return ((shift + 1) << SUB_BITS) + ((v >> shift) - SUB);
+    }
+
+    static uint64_t valueAt(size_t index) {
+        if (index < SUB) return index;
+        int shift = static_cast<int>(index >> SUB_BITS) - 1;
+        return ((index & (SUB - 1)) + SUB) << shift;
+    }
+public:
+    void record(uint64_t v) {
+        ++counts[indexOf(v)];
+        ++total;
+        max_value = max(max_value, v);
+    }
+
+    void merge(const LogLinearHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+        total += other.total;
+        max_value = max(max_value, other.max_value);
+    }
+
+    uint64_t percentile(double p) const {
+        uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(p / 100.0 * total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) return min(valueAt(i), max_value);
+        }
+        return max_value;
+    }
+
+    uint64_t maxValue() const { return max_value; }
+    uint64_t count() const { return total; }
+};
+
+// Пробы одного потока: время ожидания захвата, время удержания и число захватов,
+// сделанных, пока конкурировали все потоки (до завершения самого быстрого).
+// Без RACE_LATENCY используется пустая специализация: ни гистограмм, ни вызовов часов.
+template <bool Enabled>
+class alignas(64) BasicLatencyProbe {
+    LogLinearHistogram wait_hist;
+    LogLinearHistogram hold_hist;
+    Clock::time_point lock_requested;
+    Clock::time_point lock_acquired;
+    const atomic<bool>* someone_done = nullptr;
+    size_t contended_acquisitions = 0;
+
+    template <bool>
+    friend class BasicLatencyRecorder;
+public:
+    void beforeLock() { lock_requested = Clock::now(); }
+
+    void acquired() {
+        lock_acquired = Clock::now();
+        wait_hist.record((lock_acquired - lock_requested).count());
+        if (!someone_done->load(memory_order_relaxed)) ++contended_acquisitions;
+    }
+
+    void released() { hold_hist.record((Clock::now() - lock_acquired).count()); }
+};
+
+template <>
+class BasicLatencyProbe<false> {
+public:
+    void beforeLock() {}
+    void acquired() {}
+    void released() {}
+};
+
+// Набор проб на прогон: потоки пишут только в свою пробу, сведение — после join
+template <bool Enabled>
+class BasicLatencyRecorder {
+    vector<BasicLatencyProbe<true>> probes;
+    atomic<bool> someone_done{false};
+public:
+    explicit BasicLatencyRecorder(int threads) : probes(threads) {
+        for (auto& p : probes) p.someone_done = &someone_done;
+    }
+
+    BasicLatencyProbe<true>& probe(int i) { return probes[i]; }
+
+    void threadDone() { someone_done.store(true, memory_order_relaxed); }
+
+    // p50/p99/p99.9/max ожидания и удержания, разброс захватов по потокам и индекс Джейна
+    void addMetrics(RunSample& sample) const {
+        LogLinearHistogram wait, hold;
+        vector<double> acquisitions;
+        for (const auto& p : probes) {
+            wait.merge(p.wait_hist);
+            hold.merge(p.hold_hist);
+            acquisitions.push_back(static_cast<double>(p.contended_acquisitions));
+        }
+
+        for (auto [prefix, hist] : {pair{"wait", &wait}, pair{"hold", &hold}}) {
+            string key = prefix;
+            sample.metrics.push_back({key + "_p50_ns", static_cast<double>(hist->percentile(50))});
+            sample.metrics.push_back({key + "_p99_ns", static_cast<double>(hist->percentile(99))});
+            sample.metrics.push_back({key + "_p999_ns", static_cast<double>(hist->percentile(99.9))});
+            sample.metrics.push_back({key + "_max_ns", static_cast<double>(hist->maxValue())});
+        }
+
+        auto [minIt, maxIt] = minmax_element(acquisitions.begin(), acquisitions.end());
+        double sum = accumulate(acquisitions.begin(), acquisitions.end(), 0.0);
+        double sum_sq = inner_product(acquisitions.begin(), acquisitions.end(), acquisitions.begin(), 0.0);
+        sample.metrics.push_back({"acq_min", *minIt});
+        sample.metrics.push_back({"acq_max", *maxIt});
+        sample.metrics.push_back({"jain_index", sum_sq > 0 ? sum * sum / (acquisitions.size() * sum_sq) : 1.0});
+    }
+};
+
+template <>
+class BasicLatencyRecorder<false> {
+    BasicLatencyProbe<false> disabled;  // пустая, общая для всех потоков
+public:
+    explicit BasicLatencyRecorder(int) {}
+    BasicLatencyProbe<false>& probe(int) { return disabled; }
+    void threadDone() {}
+    void addMetrics(RunSample&) const {}
+};
+
+using LatencyProbe = BasicLatencyProbe<LATENCY_PROBES>;
+using LatencyRecorder = BasicLatencyRecorder<LATENCY_PROBES>;
+
 class MutexTest {
     mutex m;
     int cnt = 0;
-    vector<size_t> thread_times;
 public:
-    void benchmark() {
+    static constexpr const char* NAME = "MUTEX";
+
+    RunSample run(const RunConfig& cfg) {
         cnt = 0;
-        thread_times.assign(THREADS, 0);
-        vector<thread> threads;
-        
-        for (int i = 0; i < THREADS; ++i) {
-            threads.emplace_back([this, i]() {
-                auto start = chrono::high_resolution_clock::now();
-                for (int j = 0; j < ITERATIONS; ++j) {
-                    {
-                        lock_guard<mutex> lock(m);
-                        cnt++;
-                    }
-                    randomChars(5);
+        LatencyRecorder latency(cfg.threads);
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            LatencyProbe& probe = latency.probe(i);
+            for (int j = 0; j < cfg.iterations; ++j) {
+                probe.beforeLock();
+                {
+                    lock_guard<mutex> lock(m);
+                    probe.acquired();
+                    cnt++;
                 }
-                auto end = chrono::high_resolution_clock::now();
-                thread_times[i] = chrono::duration_cast<chrono::milliseconds>(end - start).count();
-            });
-        }
-        
-        for (auto& t : threads) {
-            t.join();
-        }
-
-        for (int i = 0; i < THREADS; ++i) {
-            cout << "Thread " << i << " (" << thread_times[i] << " ms)\n";
-        }
-        size_t avg = accumulate(thread_times.begin(), thread_times.end(), 0LL) / THREADS;
-        printStats(thread_times);
-        all_results.push_back({"MUTEX", avg});
+                probe.released();
+                work.run();
+            }
+            latency.threadDone();
+        });
+        latency.addMetrics(sample);
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = cnt;
+        return sample;
     }
 };
 
 class SemaphoreTest {
     counting_semaphore<1> sem{1};  // максимум 1 поток
     int cnt = 0;
-    vector<size_t> thread_times;
 public:
-    void benchmark() {
+    static constexpr const char* NAME = "SEMAPHORE";
+
+    RunSample run(const RunConfig& cfg) {
         cnt = 0;
-        thread_times.assign(THREADS, 0);
-        vector<thread> threads;
-        
-        for (int i = 0; i < THREADS; ++i) {
-            threads.emplace_back([this, i]() {
-                auto start = chrono::high_resolution_clock::now();
-                for (int j = 0; j < ITERATIONS; ++j) {
-                    sem.acquire();
-                    cnt++;
-                    sem.release();
-                    randomChars(5);
-                }
-                auto end = chrono::high_resolution_clock::now();
-                thread_times[i] = chrono::duration_cast<chrono::milliseconds>(end - start).count();
-            });
+        LatencyRecorder latency(cfg.threads);
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            LatencyProbe& probe = latency.probe(i);
+            for (int j = 0; j < cfg.iterations; ++j) {
+                probe.beforeLock();
+                sem.acquire();
+                probe.acquired();
+                cnt++;
+                sem.release();
+                probe.released();
+                work.run();
+            }
+            latency.threadDone();
+        });
+        latency.addMetrics(sample);
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = cnt;
+        return sample;
+    }
+};
+
+// Барьеры с общим интерфейсом: конструктор (число потоков, функция завершения фазы)
+// и arriveAndWait(tid). Функцию завершения вызывает последний пришедший поток
+// до того, как остальные будут отпущены.
+using PhaseCompletion = function<void()>;
+
+// std::barrier с функцией завершения
+class StdBarrier {
+    struct OnPhase {
+        PhaseCompletion* fn;
+        void operator()() noexcept { (*fn)(); }
+    };
+    PhaseCompletion completion;
+    barrier<OnPhase> bar;
+public:
+    static constexpr const char* NAME = "BARRIER";
+
+    StdBarrier(int threads, PhaseCompletion on_phase)
+        : completion(move(on_phase)), bar(threads, OnPhase{&completion}) {}
+
+    void arriveAndWait(int) { bar.arrive_and_wait(); }
+};
+
+// Централизованный барьер с обращением смысла: последний пришедший восстанавливает
+// счётчик и переворачивает общий флаг, остальные ждут флага, равного своему
+class SenseReversingBarrier {
+    struct alignas(64) LocalSense {
+        bool sense = false;
+    };
+    const int threads;
+    PhaseCompletion completion;
+    vector<LocalSense> local;
+    alignas(64) atomic<int> remaining;
+    alignas(64) atomic<bool> sense{false};
+public:
+    static constexpr const char* NAME = "BARRIER_SENSE";
+
+    SenseReversingBarrier(int threads, PhaseCompletion on_phase)
+        : threads(threads), completion(move(on_phase)), local(threads), remaining(threads) {}
+
+    void arriveAndWait(int tid) {
+        bool my_sense = local[tid].sense = !local[tid].sense;
+        if (remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+            remaining.store(threads, memory_order_relaxed);
+            completion();
+            sense.store(my_sense, memory_order_release);
+            return;
+        }
+        Backoff backoff;
+        while (sense.load(memory_order_acquire) != my_sense) backoff();
+    }
+};
+
+// Комбинирующее дерево: потоки приходят в листья по FAN_IN штук, последний в узле
+// поднимается к родителю, последний в корне завершает фазу и переворачивает флаг.
+// Счётчик общего узла трогают не более FAN_IN потоков вместо всех сразу.
+class CombiningTreeBarrier {
+    static constexpr int FAN_IN = 4;
+    struct alignas(64) TreeNode {
+        atomic<int> remaining{0};
+        int children = 0;
+        int parent = -1;
+    };
+    struct alignas(64) LocalSense {
+        bool sense = false;
+    };
+    PhaseCompletion completion;
+    vector<TreeNode> nodes;
+    vector<LocalSense> local;
+    int leaves;
+    alignas(64) atomic<bool> sense{false};
+
+    // Возвращает true, если поток был последним во всём дереве
+    bool arrive(int node) {
+        TreeNode& n = nodes[node];
+        if (n.remaining.fetch_sub(1, memory_order_acq_rel) != 1) return false;
+        // Остальные дети этого узла уже ждут флага, поэтому счётчик можно восстановить
+        n.remaining.store(n.children, memory_order_relaxed);
+        return n.parent < 0 || arrive(n.parent);
+    }
+public:
+    static constexpr const char* NAME = "BARRIER_TREE";
+
+    CombiningTreeBarrier(int threads, PhaseCompletion on_phase)
+        : completion(move(on_phase)), local(threads) {
+        // Уровни строятся снизу вверх, пока не останется один корень
+        vector<int> counts;  // число узлов на каждом уровне
+        int width = threads;
+        do {
+            width = (width + FAN_IN - 1) / FAN_IN;
+            counts.push_back(width);
+        } while (width > 1);
+
+        nodes = vector<TreeNode>(accumulate(counts.begin(), counts.end(), 0));
+        leaves = counts[0];
+        int level_start = 0, children = threads;
+        for (size_t level = 0; level < counts.size(); ++level) {
+            int next_start = level_start + counts[level];
+            for (int c = 0; c < children; ++c) {
+                TreeNode& n = nodes[level_start + c / FAN_IN];
+                n.children++;
+                if (level + 1 < counts.size()) n.parent = next_start + c / FAN_IN / FAN_IN;
+            }
+            for (int i = level_start; i < next_start; ++i) {
+                nodes[i].remaining.store(nodes[i].children, memory_order_relaxed);
+            }
+            children = counts[level];
+            level_start = next_start;
+        }
+    }
+
+    void arriveAndWait(int tid) {
+        bool my_sense = local[tid].sense = !local[tid].sense;
+        if (arrive(tid / FAN_IN)) {
+            completion();
+            sense.store(my_sense, memory_order_release);
+            return;
+        }
+        Backoff backoff;
+        while (sense.load(memory_order_acquire) != my_sense) backoff();
+    }
+};
+
+// Централизованный барьер, который после короткого спина засыпает на atomic::wait
+class SpinThenFutexBarrier {
+    static constexpr int SPIN_LIMIT = 256;
+    const int threads;
+    PhaseCompletion completion;
+    alignas(64) atomic<int> remaining;
+    alignas(64) atomic<uint32_t> phase{0};
+public:
+    static constexpr const char* NAME = "BARRIER_SPIN_FUTEX";
+
+    SpinThenFutexBarrier(int threads, PhaseCompletion on_phase)
+        : threads(threads), completion(move(on_phase)), remaining(threads) {}
+
+    void arriveAndWait(int) {
+        uint32_t my_phase = phase.load(memory_order_relaxed);
+        if (remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+            remaining.store(threads, memory_order_relaxed);
+            completion();
+            phase.store(my_phase + 1, memory_order_release);
+            phase.notify_all();
+            return;
         }
-        
-        for (auto& t : threads) t.join();
-        for (int i = 0; i < THREADS; ++i) {
-            cout << "Thread " << i << " (" << thread_times[i] << " ms)\n";
+        for (int i = 0; i < SPIN_LIMIT; ++i) {
+            if (phase.load(memory_order_acquire) != my_phase) return;
+            cpuRelax();
         }
-        size_t avg = accumulate(thread_times.begin(), thread_times.end(), 0LL) / THREADS;
-        printStats(thread_times);
-        all_results.push_back({"SEMAPHORE", avg});
+        while (phase.load(memory_order_acquire) == my_phase) phase.wait(my_phase, memory_order_acquire);
     }
 };
 
+// Фазовый бенчмарк: потоки создаются один раз и проходят iterations фаз подряд.
+// Поток 0 отмечает выход из каждой фазы, разница соседних отметок — длительность фазы.
+template <class Barrier>
 class BarrierTest {
-    barrier<> bar{THREADS};
-    int cnt = 0;
-    vector<size_t> thread_times;
+    atomic<long long> cnt{0};
 public:
-    void benchmark() {
+    static constexpr const char* NAME = Barrier::NAME;
+
+    RunSample run(const RunConfig& cfg) {
         cnt = 0;
-        thread_times.assign(THREADS, 0);
-        
-        constexpr int BARRIER_ITERATIONS = 100;
-        for (int iter = 0; iter < BARRIER_ITERATIONS; ++iter) {
-            vector<thread> threads;
-            for (int i = 0; i < THREADS; ++i) {
-                threads.emplace_back([this, i]() {
-                    auto start = chrono::high_resolution_clock::now();
-                    bar.arrive_and_wait();  // Синхронизация потоков
-                    cnt++;
-                    randomChars(5);
-                    auto end = chrono::high_resolution_clock::now();
-                    thread_times[i] += chrono::duration_cast<chrono::milliseconds>(end - start).count();
-                });
+        Barrier bar(cfg.threads, [this]() { cnt.fetch_add(1, memory_order_relaxed); });
+        LogLinearHistogram phase_hist;
+
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            auto phase_start = Clock::now();
+            for (int phase = 0; phase < cfg.iterations; ++phase) {
+                work.run();  // Работа внутри фазы
+                bar.arriveAndWait(i);
+                if (i == 0) {
+                    auto now = Clock::now();
+                    phase_hist.record((now - phase_start).count());
+                    phase_start = now;
+                }
             }
-            for (auto& t : threads) t.join();
-        }
-        for (int i = 0; i < THREADS; ++i) {
-            cout << "Thread " << i << " (" << thread_times[i] << " ms)\n";
-        }
-        size_t avg = accumulate(thread_times.begin(), thread_times.end(), 0LL) / THREADS;
-        printStats(thread_times);
-        all_results.push_back({"BARRIER", avg});
+        });
+        sample.ops = cfg.iterations;
+        sample.count = cnt.load();
+        sample.metrics.push_back({"phase_p50_ns", static_cast<double>(phase_hist.percentile(50))});
+        sample.metrics.push_back({"phase_p99_ns", static_cast<double>(phase_hist.percentile(99))});
+        sample.metrics.push_back({"phase_max_ns", static_cast<double>(phase_hist.maxValue())});
+        return sample;
     }
 };
 
 class SpinLockTest {
     atomic<bool> flag{false};
     int cnt = 0;
-    vector<size_t> thread_times;
 public:
-    void benchmark() {
+    static constexpr const char* NAME = "SPINLOCK";
+
+    RunSample run(const RunConfig& cfg) {
         cnt = 0;
-        thread_times.assign(THREADS, 0);
-        vector<thread> threads;
-        
-        for (int i = 0; i < THREADS; ++i) {
-            threads.emplace_back([this, i]() {
-                auto start = chrono::high_resolution_clock::now();
-                for (int j = 0; j < ITERATIONS; ++j) {
-                    // Spin-wait: крутиться, пока не захватим лок
-                    while (flag.exchange(true, memory_order_acquire));
-                    cnt++;
-                    flag.store(false, memory_order_release);
-                    randomChars(5);
-                }
-                auto end = chrono::high_resolution_clock::now();
-                thread_times[i] = chrono::duration_cast<chrono::milliseconds>(end - start).count();
-            });
-        }
-        
-        for (auto& t : threads) t.join();
-        for (int i = 0; i < THREADS; ++i) {
-            cout << "Thread " << i << " (" << thread_times[i] << " ms)\n";
-        }
-        size_t avg = accumulate(thread_times.begin(), thread_times.end(), 0LL) / THREADS;
-        printStats(thread_times);
-        all_results.push_back({"SPINLOCK", avg});
+        LatencyRecorder latency(cfg.threads);
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            LatencyProbe& probe = latency.probe(i);
+            for (int j = 0; j < cfg.iterations; ++j) {
+                probe.beforeLock();
+                // Spin-wait: крутиться, пока не захватим лок
+                while (flag.exchange(true, memory_order_acquire));
+                probe.acquired();
+                cnt++;
+                flag.store(false, memory_order_release);
+                probe.released();
+                work.run();
+            }
+            latency.threadDone();
+        });
+        latency.addMetrics(sample);
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = cnt;
+        return sample;
     }
 };
 
-class SpinWaitTest {
-    atomic<bool> ready{false};
-    vector<size_t> thread_times;
-
+// Бенчмарк любой блокировки из семейства выше в том же сценарии, что и SpinLockTest
+template <class Lock>
+class LockTest {
+    Lock lk;
+    int cnt = 0;
 public:
-    void benchmark() {
-        ready.store(false, memory_order_relaxed);
-        thread_times.assign(THREADS, 0);
-        vector<thread> threads;
+    static constexpr const char* NAME = Lock::NAME;
 
-        for (int i = 0; i < THREADS; ++i) {
-            threads.emplace_back([this, i]() {
-                auto start = chrono::high_resolution_clock::now();
+    RunSample run(const RunConfig& cfg) {
+        cnt = 0;
+        LatencyRecorder latency(cfg.threads);
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            typename Lock::Node node;
+            LatencyProbe& probe = latency.probe(i);
+            for (int j = 0; j < cfg.iterations; ++j) {
+                probe.beforeLock();
+                lk.lock(node);
+                probe.acquired();
+                cnt++;
+                lk.unlock(node);
+                probe.released();
+                work.run();
+            }
+            latency.threadDone();
+        });
+        latency.addMetrics(sample);
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = cnt;
+        return sample;
+    }
+};
 
-                ready.wait(false, memory_order_acquire);
+// Счётчик без блокировки: атомарный fetch_add с заданным упорядочиванием памяти
+template <memory_order Order>
+class AtomicCounterTest {
+    alignas(64) atomic<long long> cnt{0};
+public:
+    static constexpr const char* NAME = Order == memory_order_relaxed ? "ATOMIC_RELAXED" : "ATOMIC_SEQ_CST";
 
-                randomChars(5);
+    RunSample run(const RunConfig& cfg) {
+        cnt = 0;
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            for (int j = 0; j < cfg.iterations; ++j) {
+                cnt.fetch_add(1, Order);
+                work.run();
+            }
+        });
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = cnt.load();
+        return sample;
+    }
+};
 
-                auto end = chrono::high_resolution_clock::now();
-                thread_times[i] =
-                    chrono::duration_cast<chrono::milliseconds>(end - start).count();
-            });
-        }
+// Шардированный счётчик: у каждого потока своя ячейка в отдельной кэш-линии,
+// значение собирается суммированием при чтении
+class ShardedCounterTest {
+    struct alignas(64) Shard {
+        atomic<long long> value{0};
+    };
+    vector<Shard> shards;
 
-        // Даём потокам гарантированно встать на wait
-        this_thread::sleep_for(chrono::milliseconds(50));
+    long long read() const {
+        long long sum = 0;
+        for (const auto& s : shards) sum += s.value.load(memory_order_relaxed);
+        return sum;
+    }
+public:
+    static constexpr const char* NAME = "SHARDED_COUNTER";
 
-        ready.store(true, memory_order_release);
-        ready.notify_all();  // поднимаем все ожидающие потоки
+    RunSample run(const RunConfig& cfg) {
+        shards = vector<Shard>(cfg.threads);
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            atomic<long long>& mine = shards[i].value;
+            for (int j = 0; j < cfg.iterations; ++j) {
+                // Пишет только владелец, поэтому read-modify-write не нужен
+                mine.store(mine.load(memory_order_relaxed) + 1, memory_order_relaxed);
+                work.run();
+            }
+        });
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = read();
+        return sample;
+    }
+};
 
-        for (auto& t : threads) t.join();
+// Flat combining: поток публикует запрос в свою ячейку, а тот, кто захватил лок
+// комбайнера, выполняет запросы всех потоков за один проход
+class FlatCombiningCounter {
+    struct alignas(64) Slot {
+        atomic<int> pending{0};  // сколько прибавить; 0 — запрос выполнен
+    };
+    vector<Slot> slots;
+    alignas(64) atomic<bool> combining{false};
+    alignas(64) long long value = 0;
+public:
+    explicit FlatCombiningCounter(int threads) : slots(threads) {}
 
-        for (int i = 0; i < THREADS; ++i) {
-            cout << "Thread " << i << " (" << thread_times[i] << " ms)\n";
+    void add(int tid, int delta) {
+        Slot& slot = slots[tid];
+        slot.pending.store(delta, memory_order_release);
+        for (;;) {
+            if (!combining.load(memory_order_relaxed) && !combining.exchange(true, memory_order_acquire)) {
+                for (auto& s : slots) {
+                    if (int d = s.pending.load(memory_order_acquire)) {
+                        value += d;
+                        s.pending.store(0, memory_order_release);
+                    }
+                }
+                combining.store(false, memory_order_release);
+                return;
+            }
+            while (slot.pending.load(memory_order_acquire) != 0 && combining.load(memory_order_relaxed)) {
+                cpuRelax();
+            }
+            if (slot.pending.load(memory_order_acquire) == 0) return;
         }
+    }
 
-        size_t avg = accumulate(thread_times.begin(), thread_times.end(), 0LL) / THREADS;
-        printStats(thread_times);
-        all_results.push_back({"SPINWAIT (atomic_wait)", avg});
+    long long read() {
+        while (combining.exchange(true, memory_order_acquire)) cpuRelax();
+        long long v = value;
+        combining.store(false, memory_order_release);
+        return v;
     }
 };
 
+class FlatCombiningCounterTest {
+public:
+    static constexpr const char* NAME = "FLAT_COMBINING";
+
+    RunSample run(const RunConfig& cfg) {
+        FlatCombiningCounter counter(cfg.threads);
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            for (int j = 0; j < cfg.iterations; ++j) {
+                counter.add(i, 1);
+                work.run();
+            }
+        });
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = counter.read();
+        return sample;
+    }
+};
+
+// Замеряет задержку пробуждения: от notify_all до выхода потока из wait
+class SpinWaitTest {
+    atomic<bool> ready{false};
+    Clock::time_point notified_at;
+
+public:
+    static constexpr const char* NAME = "SPINWAIT";
+
+    RunSample run(const RunConfig& cfg) {
+        ready.store(false, memory_order_relaxed);
+        vector<size_t> wake_ns(cfg.threads, 0);
+
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            ready.wait(false, memory_order_acquire);
+            wake_ns[i] = elapsedNs(notified_at);
+            work.run();
+        }, [&]() {
+            // Даём потокам гарантированно встать на wait
+            this_thread::sleep_for(chrono::milliseconds(50));
+            notified_at = Clock::now();
+            ready.store(true, memory_order_release);
+            ready.notify_all();  // поднимаем все ожидающие потоки
+        });
+
+        sample.thread_ns = wake_ns;
+        sample.wall_ns = *max_element(wake_ns.begin(), wake_ns.end());
+        sample.ops = cfg.threads;
+        return sample;
+    }
+};
 
+// Производители и потребители делят потоки пополам; при одном потоке
+// запускается пара производитель/потребитель.
 class MonitorTest {
     mutex m;
     condition_variable cv;  // ожидание события
     queue<int> buffer;
-    atomic<int> produced{0};
-    vector<size_t> thread_times;
-public:
-    void benchmark() {
-        produced.store(0);
-        thread_times.assign(THREADS, 0);
-        vector<thread> threads;
-        
-        constexpr int HALF = THREADS / 2;
-        
-        // Producer
-        for (int i = 0; i < HALF; ++i) {
-            threads.emplace_back([this, i]() {
-                auto start = chrono::high_resolution_clock::now();
-                for (int j = 0; j < ITERATIONS; ++j) {
+public:
+    static constexpr const char* NAME = "MONITOR";
+
+    static vector<RunConfig> variants(const BenchConfig&, const RunConfig& base) {
+        RunConfig run = base;
+        run.producers = max(1, base.threads / 2);
+        run.consumers = max(1, base.threads - run.producers);
+        run.threads = run.producers + run.consumers;
+        return {run};
+    }
+
+    RunSample run(const RunConfig& cfg) {
+        buffer = {};
+        atomic<long long> consumed_total{0};
+        const int producers = cfg.producers;
+        const int consumers = cfg.consumers;
+        const size_t total = static_cast<size_t>(producers) * cfg.iterations;
+
+        int producers_left = producers;  // защищено m
+
+        RunSample sample = runThreads(producers + consumers, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            if (i < producers) {
+                // Producer
+                for (int j = 0; j < cfg.iterations; ++j) {
                     {
                         unique_lock<mutex> lock(m);
                         buffer.push(j);           // Добавить в буфер
-                        produced.fetch_add(1);
                     }
                     cv.notify_one();              // Пробудить ожидающий thread
-                    randomChars(5);               // Работа вне критической секции
+                    work.run();                   // Работа вне критической секции
                 }
-                auto end = chrono::high_resolution_clock::now();
-                thread_times[i] = chrono::duration_cast<chrono::milliseconds>(end - start).count();
-            });
-        }
-        
-        // Consumer
-        for (int i = HALF; i < THREADS; ++i) {
-            threads.emplace_back([this, i]() {
-                auto start = chrono::high_resolution_clock::now();
-                int consumed = 0;
-                while (consumed < (ITERATIONS / 2)) {
-                    {
-                        unique_lock<mutex> lock(m);
-                        cv.wait(lock, [this]() {  // Ждём, пока буфер не будет готов
-                            return !buffer.empty() || produced.load() >= ITERATIONS; 
-                        });
-
-                        if (!buffer.empty()) {
-                            buffer.pop();
-                            consumed++;
-                        }
-                    }
-                    randomChars(5);
+                {
+                    lock_guard<mutex> lock(m);
+                    --producers_left;
+                }
+                cv.notify_all();                  // Потребители могут заканчивать
+                return;
+            }
+
+            // Consumer: забирает элементы, пока буфер не опустеет после ухода всех производителей.
+            // Считаются реально извлечённые элементы, поэтому потеря или дублирование видны в счёте.
+            long long mine = 0;
+            for (;;) {
+                {
+                    unique_lock<mutex> lock(m);
+                    cv.wait(lock, [&]() { return !buffer.empty() || producers_left == 0; });
+                    if (buffer.empty()) break;
+                    buffer.pop();
                 }
-                auto end = chrono::high_resolution_clock::now();
-                thread_times[i] = chrono::duration_cast<chrono::milliseconds>(end - start).count();
-            });
+                ++mine;
+                work.run();
+            }
+            consumed_total.fetch_add(mine, memory_order_relaxed);
+        });
+        sample.ops = total;
+        sample.count = consumed_total.load();
+        return sample;
+    }
+};
+
+// Ограниченная MPMC-очередь Вьюкова: у каждой ячейки номер последовательности,
+// по которому производители и потребители понимают, чья сейчас очередь
+template <class T>
+class MpmcRingQueue {
+    struct Cell {
+        atomic<size_t> seq;
+        T value;
+    };
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueue_pos{0};
+    alignas(64) atomic<size_t> dequeue_pos{0};
+public:
+    explicit MpmcRingQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) cells[i].seq.store(i, memory_order_relaxed);
+    }
+
+    bool tryPush(const T& value) {
+        size_t pos = enqueue_pos.load(memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // очередь полна
+            } else {
+                pos = enqueue_pos.load(memory_order_relaxed);
+            }
         }
-        
-        for (auto& t : threads) t.join();
-        for (int i = 0; i < THREADS; ++i) {
-            cout << "Thread " << i << " (" << thread_times[i] << " ms)\n";
+    }
+
+    bool tryPop(T& value) {
+        size_t pos = dequeue_pos.load(memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // очередь пуста
+            } else {
+                pos = dequeue_pos.load(memory_order_relaxed);
+            }
         }
-        size_t avg = accumulate(thread_times.begin(), thread_times.end(), 0LL) / THREADS;
-        printStats(thread_times);
-        all_results.push_back({"MONITOR", avg});
+    }
+
+    // Пакетные операции возвращают, сколько элементов удалось передать
+    size_t tryPushBatch(const T* items, size_t n) {
+        size_t done = 0;
+        while (done < n && tryPush(items[done])) ++done;
+        return done;
+    }
+
+    size_t tryPopBatch(T* out, size_t n) {
+        size_t done = 0;
+        while (done < n && tryPop(out[done])) ++done;
+        return done;
     }
 };
 
-int main() {
-    cout << "Threads: " << THREADS << " | Iterations: " << ITERATIONS << "\n\n";
-    
-    cout << "> MUTEX\n";
-    MutexTest().benchmark();
-    cout << "\n";
-    
-    cout << "> SEMAPHORE\n";
-    SemaphoreTest().benchmark();
-    cout << "\n";
-    
-    cout << "> BARRIER\n";
-    BarrierTest().benchmark();
-    cout << "\n";
-    
-    cout << "> SPINLOCK\n";
-    SpinLockTest().benchmark();
-    cout << "\n";
-    
-    cout << "> SPINWAIT\n";
-    SpinWaitTest().benchmark();
-    cout << "\n";
-    
-    cout << "> MONITOR\n";
-    MonitorTest().benchmark();
+// SPSC-кольцо: каждый индекс пишет только одна сторона, чужой индекс кэшируется
+// и перечитывается, только когда закэшированного места не хватает
+template <class T>
+class SpscRingQueue {
+    vector<T> buffer;
+    size_t mask;
+    alignas(64) atomic<size_t> head{0};  // пишет производитель
+    size_t cached_tail = 0;
+    alignas(64) atomic<size_t> tail{0};  // пишет потребитель
+    size_t cached_head = 0;
+public:
+    explicit SpscRingQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    size_t tryPushBatch(const T* items, size_t n) {
+        size_t h = head.load(memory_order_relaxed);
+        if (buffer.size() - (h - cached_tail) < n) cached_tail = tail.load(memory_order_acquire);
+        size_t count = min(n, buffer.size() - (h - cached_tail));
+        for (size_t i = 0; i < count; ++i) buffer[(h + i) & mask] = items[i];
+        head.store(h + count, memory_order_release);
+        return count;
+    }
+
+    size_t tryPopBatch(T* out, size_t n) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (cached_head - t < n) cached_head = head.load(memory_order_acquire);
+        size_t count = min(n, cached_head - t);
+        for (size_t i = 0; i < count; ++i) out[i] = buffer[(t + i) & mask];
+        tail.store(t + count, memory_order_release);
+        return count;
+    }
+};
+
+uint64_t nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Производитель: iterations элементов пакетами по batch, элемент — время постановки.
+// Метка ставится непосредственно перед каждой попыткой вставки, чтобы в задержку очереди
+// не попадали работа производителя и ожидание места.
+template <class Queue>
+void produceItems(Queue& queue, int iterations, int batch, OutsideWork& work) {
+    vector<uint64_t> items(batch);
+    Backoff backoff;
+    for (int sent = 0; sent < iterations;) {
+        size_t n = min(batch, iterations - sent);
+        for (size_t k = 0; k < n; ++k) work.run();  // Работа вне очереди, как в MONITOR
+        for (size_t pushed = 0; pushed < n;) {
+            fill(items.begin() + pushed, items.begin() + n, nowNs());
+            size_t k = queue.tryPushBatch(items.data() + pushed, n - pushed);
+            if (k == 0) {
+                backoff();
+                continue;
+            }
+            backoff.reset();
+            pushed += k;
+        }
+        sent += n;
+    }
+}
+
+struct ConsumerStats {
+    size_t consumed = 0;
+    uint64_t latency_sum_ns = 0;
+    uint64_t latency_max_ns = 0;
+};
+
+// Потребитель: забирает элементы, пока очередь не опустеет после ухода всех производителей,
+// и копит задержку от постановки до извлечения. Считаются реально извлечённые элементы,
+// поэтому потеря или дублирование в очереди видны в итоговом счёте.
+template <class Queue>
+ConsumerStats consumeItems(Queue& queue, const atomic<int>& producers_left, int batch, OutsideWork& work) {
+    ConsumerStats stats;
+    vector<uint64_t> items(batch);
+    Backoff backoff;
+    for (;;) {
+        // Флаг читается до попытки: если производителей уже нет и очередь пуста, новых элементов не будет
+        bool finished = producers_left.load(memory_order_acquire) == 0;
+        size_t k = queue.tryPopBatch(items.data(), batch);
+        if (k == 0) {
+            if (finished) break;
+            backoff();
+            continue;
+        }
+        backoff.reset();
+        uint64_t now = nowNs();
+        for (size_t i = 0; i < k; ++i) {
+            uint64_t latency = now - items[i];
+            stats.latency_sum_ns += latency;
+            stats.latency_max_ns = max(stats.latency_max_ns, latency);
+            work.run();
+        }
+        stats.consumed += k;
+    }
+    return stats;
+}
+
+void addQueueMetrics(RunSample& sample, const vector<ConsumerStats>& stats) {
+    size_t consumed = 0;
+    uint64_t latency_sum = 0, latency_max = 0;
+    for (const auto& s : stats) {
+        consumed += s.consumed;
+        latency_sum += s.latency_sum_ns;
+        latency_max = max(latency_max, s.latency_max_ns);
+    }
+    sample.count = consumed;
+    sample.metrics.push_back({"avg_latency_ns", consumed ? static_cast<double>(latency_sum) / consumed : 0.0});
+    sample.metrics.push_back({"max_latency_ns", static_cast<double>(latency_max)});
+}
+
+// MPMC-очередь в сценарии производитель/потребитель с заданным соотношением и пакетами
+class MpmcQueueTest {
+public:
+    static constexpr const char* NAME = "MPMC_RING";
+
+    static vector<RunConfig> variants(const BenchConfig& cfg, const RunConfig& base) {
+        vector<RunConfig> runs;
+        for (auto [p, c] : cfg.pc_ratios) {
+            for (int batch : cfg.batches) {
+                RunConfig run = base;
+                run.producers = max(1, static_cast<int>(lround(base.threads * double(p) / (p + c))));
+                run.producers = min(run.producers, max(1, base.threads - 1));
+                run.consumers = max(1, base.threads - run.producers);
+                run.threads = run.producers + run.consumers;
+                run.batch = batch;
+                run.queue_capacity = cfg.queue_capacity;
+                run.variant = "P" + to_string(run.producers) + ":C" + to_string(run.consumers) +
+                              " B" + to_string(batch);
+                // При малом числе потоков разные соотношения дают одинаковое разбиение
+                bool duplicate = any_of(runs.begin(), runs.end(), [&](const RunConfig& r) {
+                    return r.variant == run.variant;
+                });
+                if (!duplicate) runs.push_back(run);
+            }
+        }
+        return runs;
+    }
+
+    RunSample run(const RunConfig& cfg) {
+        MpmcRingQueue<uint64_t> queue(cfg.queue_capacity);
+        const size_t total = static_cast<size_t>(cfg.producers) * cfg.iterations;
+        vector<ConsumerStats> stats(cfg.consumers);
+        atomic<int> producers_left{cfg.producers};
+
+        RunSample sample = runThreads(cfg.producers + cfg.consumers, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            if (i < cfg.producers) {
+                produceItems(queue, cfg.iterations, cfg.batch, work);
+                producers_left.fetch_sub(1, memory_order_release);
+                return;
+            }
+            stats[i - cfg.producers] = consumeItems(queue, producers_left, cfg.batch, work);
+        });
+        sample.ops = total;
+        addQueueMetrics(sample, stats);
+        return sample;
+    }
+};
+
+// SPSC-очереди: потоки разбиваются на независимые пары производитель/потребитель
+class SpscQueueTest {
+public:
+    static constexpr const char* NAME = "SPSC_RING";
+
+    static vector<RunConfig> variants(const BenchConfig& cfg, const RunConfig& base) {
+        vector<RunConfig> runs;
+        for (int batch : cfg.batches) {
+            RunConfig run = base;
+            run.producers = run.consumers = max(1, base.threads / 2);
+            run.threads = run.producers + run.consumers;
+            run.batch = batch;
+            run.queue_capacity = cfg.queue_capacity;
+            run.variant = to_string(run.producers) + " pairs B" + to_string(batch);
+            runs.push_back(run);
+        }
+        return runs;
+    }
+
+    RunSample run(const RunConfig& cfg) {
+        const int pairs = cfg.producers;
+        vector<unique_ptr<SpscRingQueue<uint64_t>>> queues;
+        for (int q = 0; q < pairs; ++q) {
+            queues.push_back(make_unique<SpscRingQueue<uint64_t>>(cfg.queue_capacity));
+        }
+        vector<ConsumerStats> stats(pairs);
+        vector<atomic<int>> producer_left(pairs);  // у каждой пары свой производитель
+        for (auto& p : producer_left) p.store(1, memory_order_relaxed);
+
+        RunSample sample = runThreads(pairs * 2, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            if (i < pairs) {
+                produceItems(*queues[i], cfg.iterations, cfg.batch, work);
+                producer_left[i].fetch_sub(1, memory_order_release);
+            } else {
+                stats[i - pairs] = consumeItems(*queues[i - pairs], producer_left[i - pairs], cfg.batch, work);
+            }
+        });
+        sample.ops = static_cast<size_t>(pairs) * cfg.iterations;
+        addQueueMetrics(sample, stats);
+        return sample;
+    }
+};
+
+// Примитивы чтения-записи с общим интерфейсом: конструктор (число потоков),
+// read(tid) — снимок записи, write(tid) — увеличить запись на 1, value() — значение
+// после завершения потоков. Запись — RW_WORDS слов с одинаковым значением:
+// если читатель видит разные слова, он прочитал запись посреди изменения.
+constexpr int RW_WORDS = 4;
+
+struct RwRecord {
+    long long words[RW_WORDS] = {};
+
+    bool consistent() const {
+        return all_of(begin(words), end(words), [&](long long w) { return w == words[0]; });
+    }
+
+    void increment() {
+        for (auto& w : words) ++w;
+    }
+};
+
+// std::shared_mutex: читатели берут разделяемый захват, писатель — исключительный
+class SharedMutexRw {
+    shared_mutex m;
+    RwRecord record;
+public:
+    static constexpr const char* NAME = "SHARED_MUTEX";
+
+    explicit SharedMutexRw(int) {}
+
+    RwRecord read(int) {
+        shared_lock<shared_mutex> lock(m);
+        return record;
+    }
+
+    void write(int) {
+        lock_guard<shared_mutex> lock(m);
+        record.increment();
+    }
+
+    long long value() const { return record.words[0]; }
+};
+
+// Seqlock: писатель делает номер версии нечётным на время изменения, читатель
+// ничего не пишет и повторяет чтение, если версия была нечётной или сменилась
+class SeqLockRw {
+    alignas(64) atomic<uint32_t> seq{0};
+    atomic<long long> words[RW_WORDS] = {};
+    TTASBackoffLock writers;  // писатели между собой сериализуются
+public:
+    static constexpr const char* NAME = "SEQLOCK";
+
+    explicit SeqLockRw(int) {}
+
+    RwRecord read(int) {
+        RwRecord r;
+        for (;;) {
+            uint32_t before = seq.load(memory_order_acquire);
+            if (before & 1) {
+                cpuRelax();
+                continue;
+            }
+            for (int k = 0; k < RW_WORDS; ++k) r.words[k] = words[k].load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (seq.load(memory_order_relaxed) == before) return r;
+        }
+    }
+
+    void write(int) {
+        TTASBackoffLock::Node node;
+        writers.lock(node);
+        uint32_t s = seq.load(memory_order_relaxed);
+        seq.store(s + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (auto& w : words) w.store(w.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        seq.store(s + 2, memory_order_release);
+        writers.unlock(node);
+    }
+
+    long long value() const { return words[0].load(); }
+};
+
+// "Big reader" лок: у каждого читателя свой флаг в отдельной кэш-линии, поэтому
+// читатели не делят ни одной записываемой линии. Писатель поднимает общий флаг
+// и ждёт, пока все читатели выйдут; читатель, увидевший писателя, уступает ему.
+class BigReaderRw {
+    struct alignas(64) ReaderSlot {
+        atomic<bool> active{false};
+    };
+    vector<ReaderSlot> readers;
+    alignas(64) atomic<bool> writer{false};
+    RwRecord record;
+public:
+    static constexpr const char* NAME = "BIG_READER";
+
+    explicit BigReaderRw(int threads) : readers(threads) {}
+
+    RwRecord read(int tid) {
+        atomic<bool>& mine = readers[tid].active;
+        for (;;) {
+            mine.store(true, memory_order_seq_cst);
+            if (!writer.load(memory_order_seq_cst)) break;
+            mine.store(false, memory_order_relaxed);
+            while (writer.load(memory_order_relaxed)) cpuRelax();
+        }
+        RwRecord r = record;
+        mine.store(false, memory_order_release);
+        return r;
+    }
+
+    void write(int) {
+        Backoff backoff;
+        while (writer.exchange(true, memory_order_seq_cst)) backoff();
+        for (auto& slot : readers) {
+            while (slot.active.load(memory_order_seq_cst)) cpuRelax();
+        }
+        record.increment();
+        writer.store(false, memory_order_release);
+    }
+
+    long long value() const { return record.words[0]; }
+};
+
+// RCU на эпохах: читатель объявляет текущую эпоху и читает неизменяемый снимок
+// по указателю. Писатель публикует копию с изменением, а старый снимок откладывает
+// до момента, когда ни один читатель не может его держать.
+class EpochRcuRw {
+    struct alignas(64) ReaderSlot {
+        atomic<uint64_t> epoch{0};  // 0 — читатель вне секции
+    };
+    struct Retired {
+        const RwRecord* snapshot;
+        uint64_t epoch;  // эпоха, в которой снимок перестал быть текущим
+    };
+    vector<ReaderSlot> readers;
+    alignas(64) atomic<const RwRecord*> current{new RwRecord};
+    alignas(64) atomic<uint64_t> global_epoch{1};
+    TTASBackoffLock writers;
+    vector<Retired> retired;  // под writers
+    size_t retired_max = 0;
+
+    // Освобождает снимки, которые старше самой ранней эпохи активных читателей
+    void reclaim() {
+        uint64_t oldest = UINT64_MAX;
+        for (const auto& slot : readers) {
+            uint64_t e = slot.epoch.load(memory_order_seq_cst);
+            if (e) oldest = min(oldest, e);
+        }
+        auto freed = remove_if(retired.begin(), retired.end(), [&](const Retired& r) {
+            if (r.epoch >= oldest) return false;
+            delete r.snapshot;
+            return true;
+        });
+        retired.erase(freed, retired.end());
+    }
+public:
+    static constexpr const char* NAME = "RCU_EPOCH";
+
+    explicit EpochRcuRw(int threads) : readers(threads) {
+        retired.reserve(64);
+    }
+
+    EpochRcuRw(const EpochRcuRw&) = delete;
+    EpochRcuRw& operator=(const EpochRcuRw&) = delete;
+
+    ~EpochRcuRw() {
+        for (const auto& r : retired) delete r.snapshot;
+        delete current.load();
+    }
+
+    RwRecord read(int tid) {
+        atomic<uint64_t>& mine = readers[tid].epoch;
+        mine.store(global_epoch.load(memory_order_relaxed), memory_order_seq_cst);
+        RwRecord r = *current.load(memory_order_seq_cst);
+        mine.store(0, memory_order_release);
+        return r;
+    }
+
+    void write(int) {
+        TTASBackoffLock::Node node;
+        writers.lock(node);
+        const RwRecord* old = current.load(memory_order_relaxed);
+        RwRecord* next = new RwRecord(*old);
+        next->increment();
+        current.store(next, memory_order_seq_cst);
+        retired.push_back({old, global_epoch.fetch_add(1, memory_order_seq_cst)});
+        retired_max = max(retired_max, retired.size());
+        reclaim();
+        writers.unlock(node);
+    }
+
+    long long value() const { return current.load()->words[0]; }
+
+    void addMetrics(RunSample& sample) const {
+        sample.metrics.push_back({"retired_max", static_cast<double>(retired_max)});
+    }
+};
+
+// Смешанная нагрузка чтения и записи: в каждом окне из read_weight + write_weight
+// операций потока write_weight — записи, окна потоков сдвинуты друг относительно друга.
+// Счётчик — согласованные чтения плюс итоговое значение записи, должен совпасть с числом операций.
+template <class Rw>
+class ReadWriteTest {
+    struct alignas(64) ThreadStats {
+        size_t reads = 0;
+        size_t consistent = 0;
+        LogLinearHistogram write_hist;
+    };
+public:
+    static constexpr const char* NAME = Rw::NAME;
+
+    static vector<RunConfig> variants(const BenchConfig& cfg, const RunConfig& base) {
+        vector<RunConfig> runs;
+        for (auto [r, w] : cfg.rw_ratios) {
+            RunConfig run = base;
+            run.read_weight = r;
+            run.write_weight = w;
+            run.variant = "R" + to_string(r) + ":W" + to_string(w);
+            runs.push_back(run);
+        }
+        return runs;
+    }
+
+    RunSample run(const RunConfig& cfg) {
+        Rw rw(cfg.threads);
+        vector<ThreadStats> stats(cfg.threads);
+        const int period = cfg.read_weight + cfg.write_weight;
+
+        RunSample sample = runThreads(cfg.threads, [&](int i) {
+            OutsideWork work(cfg.work, i);
+            ThreadStats& local = stats[i];  // выделена до старта, в замер не входит
+            for (int j = 0; j < cfg.iterations; ++j) {
+                if ((j + i) % period < cfg.write_weight) {
+                    auto start = Clock::now();
+                    rw.write(i);
+                    local.write_hist.record((Clock::now() - start).count());
+                } else {
+                    RwRecord r = rw.read(i);
+                    ++local.reads;
+                    local.consistent += r.consistent();
+                }
+                work.run();
+            }
+        });
+
+        size_t reads = 0, consistent = 0;
+        LogLinearHistogram writes;
+        for (const auto& s : stats) {
+            reads += s.reads;
+            consistent += s.consistent;
+            writes.merge(s.write_hist);
+        }
+        sample.ops = static_cast<size_t>(cfg.threads) * cfg.iterations;
+        sample.count = static_cast<long long>(consistent) + rw.value();
+        sample.metrics.push_back({"reads_per_sec", reads * 1e9 / max<size_t>(sample.wall_ns, 1)});
+        sample.metrics.push_back({"write_p50_ns", static_cast<double>(writes.percentile(50))});
+        sample.metrics.push_back({"write_p99_ns", static_cast<double>(writes.percentile(99))});
+        sample.metrics.push_back({"write_max_ns", static_cast<double>(writes.maxValue())});
+        if constexpr (requires { rw.addMetrics(sample); }) rw.addMetrics(sample);
+        return sample;
+    }
+};
+
+// Прогрев, измеряемые повторы и статистика для одной конфигурации
+template <class Test>
+TestResult measure(const BenchConfig& cfg, const RunConfig& run) {
+    bool count_ok = true;
+    auto check = [&](const RunSample& s) {
+        if (s.count >= 0 && static_cast<size_t>(s.count) != s.ops) {
+            cout << "  COUNT MISMATCH: expected " << s.ops << ", got " << s.count << "\n";
+            count_ok = false;
+        }
+    };
+
+    for (int w = 0; w < cfg.warmup; ++w) {
+        check(Test().run(run));
+    }
+
+    vector<RunSample> samples;
+    for (int r = 0; r < cfg.repetitions; ++r) {
+        samples.push_back(Test().run(run));
+        check(samples.back());
+    }
+    sort(samples.begin(), samples.end(), [](const RunSample& a, const RunSample& b) {
+        return a.wall_ns < b.wall_ns;
+    });
+
+    vector<size_t> walls;
+    for (const auto& s : samples) walls.push_back(s.wall_ns);
+    const RunSample& median_run = samples[(samples.size() - 1) / 2];
+
+    TestResult result{Test::NAME, run.variant, run.threads, run.iterations,
+                      percentile(walls, 50), percentile(walls, 95), percentile(walls, 99),
+                      median_run.ops * 1e9 / max<size_t>(percentile(walls, 50), 1),
+                      fairness(median_run.thread_ns), median_run.thread_ns, count_ok,
+                      median_run.metrics, median_run.placement, run.work.describe()};
+    printStats(result, median_run);
+    return result;
+}
+
+// Перебирает потоки, итерации и варианты сценария, если тест их объявляет
+template <class Test>
+void runBenchmark(const BenchConfig& cfg) {
+    if (!cfg.tests.empty() && find(cfg.tests.begin(), cfg.tests.end(), Test::NAME) == cfg.tests.end()) {
+        return;
+    }
+
+    cout << "> " << Test::NAME << "\n";
+    for (int threads : cfg.threads) {
+        for (int iterations : cfg.iterations) {
+            RunConfig base{threads, iterations};
+            base.work = cfg.work;
+            vector<RunConfig> runs = {base};
+            if constexpr (requires { Test::variants(cfg, base); }) {
+                runs = Test::variants(cfg, base);
+            }
+            for (const RunConfig& run : runs) {
+                // Сценарии с парами потоков округляют число потоков, и соседние значения
+                // --threads могут дать уже измеренную конфигурацию
+                bool measured = any_of(all_results.begin(), all_results.end(), [&](const TestResult& r) {
+                    return r.name == Test::NAME && r.variant == run.variant && r.threads == run.threads &&
+                           r.iterations == run.iterations;
+                });
+                if (!measured) all_results.push_back(measure<Test>(cfg, run));
+            }
+        }
+    }
     cout << "\n";
-    
+}
+
+struct HostInfo {
+    string hostname;
+    string kernel;
+    string compiler;
+    unsigned hardware_threads;
+    string timestamp;
+};
+
+HostInfo collectHostInfo() {
+    HostInfo info;
+    char name[256] = {};
+    gethostname(name, sizeof(name) - 1);
+    info.hostname = name;
+
+    utsname uts{};
+    if (uname(&uts) == 0) info.kernel = string(uts.sysname) + " " + uts.release + " " + uts.machine;
+
+#if defined(__clang__)
+    info.compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    info.compiler = "gcc " __VERSION__;
+#else
+    info.compiler = "unknown";
+#endif
+    info.hardware_threads = thread::hardware_concurrency();
+
+    char buf[32];
+    time_t now = time(nullptr);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    info.timestamp = buf;
+    return info;
+}
+
+string jsonEscape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+bool writeJson(const string& path, const HostInfo& host, const BenchConfig& cfg) {
+    ofstream out(path);
+    if (!out) return false;
+    out << "{\n  \"host\": {\"hostname\": \"" << jsonEscape(host.hostname)
+        << "\", \"kernel\": \"" << jsonEscape(host.kernel)
+        << "\", \"compiler\": \"" << jsonEscape(host.compiler)
+        << "\", \"hardware_threads\": " << host.hardware_threads
+        << ", \"timestamp\": \"" << host.timestamp << "\""
+        << ", \"topology\": \"" << topology.describe() << "\"},\n"
+        << "  \"warmup\": " << cfg.warmup << ",\n"
+        << "  \"repetitions\": " << cfg.repetitions << ",\n"
+        << "  \"work\": \"" << cfg.work.describe() << "\",\n"
+        << "  \"results\": [";
+
+    for (size_t i = 0; i < all_results.size(); ++i) {
+        const auto& r = all_results[i];
+        out << (i ? "," : "") << "\n    {\"name\": \"" << jsonEscape(r.name) << "\""
+            << ", \"variant\": \"" << jsonEscape(r.variant) << "\""
+            << ", \"placement\": \"" << r.placement << "\""
+            << ", \"threads\": " << r.threads
+            << ", \"iterations\": " << r.iterations
+            << ", \"median_ns\": " << r.median_ns
+            << ", \"p95_ns\": " << r.p95_ns
+            << ", \"p99_ns\": " << r.p99_ns
+            << ", \"ops_per_sec\": " << fixed << setprecision(1) << r.ops_per_sec
+            << ", \"fairness\": " << setprecision(3) << r.fairness
+            << ", \"count_ok\": " << (r.count_ok ? "true" : "false")
+            << ", \"thread_ns\": [";
+        for (size_t t = 0; t < r.thread_ns.size(); ++t) out << (t ? ", " : "") << r.thread_ns[t];
+        out << "], \"metrics\": {";
+        for (size_t m = 0; m < r.metrics.size(); ++m) {
+            out << (m ? ", " : "") << "\"" << jsonEscape(r.metrics[m].first) << "\": " << r.metrics[m].second;
+        }
+        out << "}}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// Формат CSV: thread_ns — времена потоков через ';', metrics — пары key=value через ';',
+// placement — политика и процессоры потоков через ',', work — работа вне критической секции
+bool writeCsv(const string& path, const HostInfo& host) {
+    ofstream out(path);
+    if (!out) return false;
+    out << "name,variant,threads,iterations,median_ns,p95_ns,p99_ns,ops_per_sec,fairness,count_ok,host,thread_ns,metrics,placement,work\n";
+    for (const auto& r : all_results) {
+        out << r.name << "," << r.variant << "," << r.threads << "," << r.iterations << ","
+            << r.median_ns << "," << r.p95_ns << "," << r.p99_ns << ","
+            << fixed << setprecision(1) << r.ops_per_sec << ","
+            << setprecision(3) << r.fairness << "," << r.count_ok << "," << host.hostname << ",";
+        for (size_t t = 0; t < r.thread_ns.size(); ++t) out << (t ? ";" : "") << r.thread_ns[t];
+        out << ",";
+        for (size_t m = 0; m < r.metrics.size(); ++m) {
+            out << (m ? ";" : "") << r.metrics[m].first << "=" << r.metrics[m].second;
+        }
+        out << ",\"" << r.placement << "\"," << r.work << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+using ResultKey = tuple<string, string, int, int, string>;  // name, variant, threads, iterations, work
+
+// Загружает медианы из CSV, ранее сохранённого через --csv.
+// Колонки ищутся по заголовку, поэтому подходят и файлы старых версий без variant и work
+// (в них работа всегда была по умолчанию).
+bool loadBaseline(const string& path, map<ResultKey, size_t>& baseline) {
+    ifstream in(path);
+    if (!in) return false;
+
+    // placement заключён в кавычки и может содержать запятые
+    auto split = [](const string& line) {
+        vector<string> fields(1);
+        bool quoted = false;
+        for (char c : line) {
+            if (c == '"') quoted = !quoted;
+            else if (c == ',' && !quoted) fields.emplace_back();
+            else fields.back() += c;
+        }
+        return fields;
+    };
+
+    string line;
+    getline(in, line);
+    map<string, size_t> column;
+    vector<string> header = split(line);
+    for (size_t i = 0; i < header.size(); ++i) column[header[i]] = i;
+    if (!column.count("name") || !column.count("threads") || !column.count("iterations") ||
+        !column.count("median_ns")) {
+        return false;
+    }
+
+    for (size_t line_no = 2; getline(in, line); ++line_no) {
+        vector<string> f = split(line);
+        if (f.size() < header.size() - 1) continue;  // пустые хвостовые поля getline не возвращает
+        auto get = [&](const string& name) {
+            auto it = column.find(name);
+            return it != column.end() && it->second < f.size() ? f[it->second] : string();
+        };
+        try {
+            string work = column.count("work") ? get("work") : WorkSpec{}.describe();
+            baseline[{get("name"), get("variant"), stoi(get("threads")), stoi(get("iterations")), work}] =
+                stoull(get("median_ns"));
+        } catch (const exception&) {
+            cerr << path << ":" << line_no << ": malformed baseline row\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Возвращает количество конфигураций, медиана которых выросла больше порога
+int compareWithBaseline(const map<ResultKey, size_t>& baseline, double threshold_pct) {
+    int regressions = 0;
+    cout << "> BASELINE (threshold " << fixed << setprecision(1) << threshold_pct << "%)\n";
+    set<string> other_work;
+    for (const auto& [key, median] : baseline) {
+        if (!all_results.empty() && get<4>(key) != all_results[0].work) other_work.insert(get<4>(key));
+    }
+    for (const auto& w : other_work) {
+        cout << "  WARNING: baseline rows recorded with --work " << w << " are not compared (this run: "
+             << all_results[0].work << ")\n";
+    }
+    for (const auto& r : all_results) {
+        auto it = baseline.find({r.name, r.variant, r.threads, r.iterations, r.work});
+        if (it == baseline.end()) continue;
+
+        double delta = (static_cast<double>(r.median_ns) / max<size_t>(it->second, 1) - 1.0) * 100.0;
+        bool regressed = delta > threshold_pct;
+        regressions += regressed;
+        cout << "  " << (regressed ? "REGRESSION " : "ok         ") << displayName(r)
+             << " T=" << r.threads << " I=" << r.iterations << ": "
+             << it->second << " -> " << r.median_ns << " ns ("
+             << showpos << setprecision(1) << delta << noshowpos << "%)\n";
+    }
+    return regressions;
+}
+
+vector<int> parseIntList(const string& s) {
+    vector<int> values;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        int v = stoi(item);
+        if (v <= 0) throw invalid_argument(item);
+        values.push_back(v);
+    }
+    return values;
+}
+
+// "chars:5", "spin:200", "none"
+WorkSpec parseWorkSpec(const string& s) {
+    WorkSpec spec;
+    if (s == "none") {
+        spec.kind = WorkSpec::NONE;
+        spec.amount = 0;
+        return spec;
+    }
+    size_t colon = s.find(':');
+    if (colon == string::npos) throw invalid_argument(s);
+    string kind = s.substr(0, colon);
+    if (kind == "chars") spec.kind = WorkSpec::CHARS;
+    else if (kind == "spin") spec.kind = WorkSpec::SPIN;
+    else throw invalid_argument(s);
+    spec.amount = stoi(s.substr(colon + 1));
+    if (spec.amount < 0 || (spec.kind == WorkSpec::CHARS && spec.amount > WorkSpec::MAX_CHARS)) {
+        throw invalid_argument(s);
+    }
+    return spec;
+}
+
+// "1:1,1:3" -> {{1, 1}, {1, 3}}. allow_zero — одна из сторон может быть 0 (только чтения
+// или только записи), но не обе
+vector<pair<int, int>> parseRatioList(const string& s, bool allow_zero = false) {
+    vector<pair<int, int>> ratios;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == string::npos) throw invalid_argument(item);
+        int p = stoi(item.substr(0, colon));
+        int c = stoi(item.substr(colon + 1));
+        if (p < 0 || c < 0 || p + c == 0 || (!allow_zero && (p == 0 || c == 0))) throw invalid_argument(item);
+        ratios.push_back({p, c});
+    }
+    return ratios;
+}
+
+vector<int> defaultThreadCounts() {
+    int hw = max(1u, thread::hardware_concurrency());
+    vector<int> counts;
+    for (int t = 1; t < hw; t *= 2) counts.push_back(t);
+    counts.push_back(hw);
+    counts.push_back(hw * 2);  // переподписка
+    return counts;
+}
+
+void printUsage(const char* prog) {
+    cout << "Usage: " << prog << " [options]\n"
+         << "  --threads LIST     thread counts to sweep (default: powers of two up to hw, hw, 2*hw)\n"
+         << "  --iterations LIST  iterations per thread to sweep (default: 10000)\n"
+         << "  --warmup N         warmup runs per configuration (default: 2)\n"
+         << "  --reps N           measured runs per configuration (default: 10)\n"
+         << "  --tests LIST       run only the named tests, e.g. MUTEX,SPINLOCK\n"
+         << "  --pc-ratio LIST    producer:consumer ratios for queue tests (default: 1:1)\n"
+         << "  --batch LIST       push/pop batch sizes for queue tests (default: 1)\n"
+         << "  --queue-capacity N ring buffer capacity (default: 1024)\n"
+         << "  --rw-ratio LIST    reader:writer operation ratios for read-write tests\n"
+         << "                     (default: 99:1,90:10,50:50; 100:0 and 0:100 allowed)\n"
+         << "  --work SPEC        work outside the critical section: chars:N (N <= 4096, default chars:5),\n"
+         << "                     spin:NS (calibrated busy loop) or none\n"
+         << "  --pin POLICY       thread placement: none (default), compact, scatter,\n"
+         << "                     one-per-core, smt-pairs\n"
+         << "  --json PATH        write results as JSON\n"
+         << "  --csv PATH         write results as CSV (usable as a baseline)\n"
+         << "  --baseline PATH    compare medians with a CSV from a previous run\n"
+         << "  --threshold PCT    allowed median slowdown vs baseline (default: 10)\n"
+         << "Exit status: 3 when a counter check failed, otherwise 2 on baseline regression\n";
+}
+
+bool parseArgs(int argc, char** argv, BenchConfig& cfg) {
+    cfg.threads = defaultThreadCounts();
+    cfg.iterations = {10000};
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return false;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        string value = argv[++i];
+        try {
+            if (arg == "--threads") cfg.threads = parseIntList(value);
+            else if (arg == "--iterations") cfg.iterations = parseIntList(value);
+            else if (arg == "--warmup") cfg.warmup = stoi(value);
+            else if (arg == "--reps") cfg.repetitions = parseIntList(value).at(0);
+            else if (arg == "--batch") cfg.batches = parseIntList(value);
+            else if (arg == "--queue-capacity") cfg.queue_capacity = parseIntList(value).at(0);
+            else if (arg == "--pc-ratio") cfg.pc_ratios = parseRatioList(value);
+            else if (arg == "--rw-ratio") cfg.rw_ratios = parseRatioList(value, true);
+            else if (arg == "--work") cfg.work = parseWorkSpec(value);
+            else if (arg == "--pin") {
+                if (!parsePinPolicy(value, cfg.pin)) throw invalid_argument(value);
+            }
+            else if (arg == "--json") cfg.json_path = value;
+            else if (arg == "--csv") cfg.csv_path = value;
+            else if (arg == "--baseline") cfg.baseline_path = value;
+            else if (arg == "--threshold") cfg.threshold_pct = stod(value);
+            else if (arg == "--tests") {
+                stringstream ss(value);
+                string name;
+                while (getline(ss, name, ',')) cfg.tests.push_back(name);
+            } else {
+                cerr << "Unknown option " << arg << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        } catch (const exception&) {
+            cerr << "Invalid value for " << arg << ": " << value << "\n";
+            return false;
+        }
+    }
+    return cfg.warmup >= 0;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) return 1;
+
+    map<ResultKey, size_t> baseline;
+    if (!cfg.baseline_path.empty() && !loadBaseline(cfg.baseline_path, baseline)) {
+        cerr << "Cannot read baseline " << cfg.baseline_path << "\n";
+        return 1;
+    }
+
+    if (cfg.work.kind == WorkSpec::SPIN) calibrateSpin();
+    topology = Topology::detect();
+    pin_policy = cfg.pin;
+
+    HostInfo host = collectHostInfo();
+    cout << "Host: " << host.hostname << " | " << host.kernel << " | " << host.compiler << "\n";
+    cout << "Topology: " << topology.describe() << " | Pinning: " << pinPolicyName(pin_policy) << "\n";
+    cout << "Hardware threads: " << host.hardware_threads
+         << " | Warmup: " << cfg.warmup << " | Repetitions: " << cfg.repetitions
+         << " | Latency probes: " << (LATENCY_PROBES ? "on" : "off")
+         << " | Work: " << cfg.work.describe() << "\n\n";
+
+    runBenchmark<MutexTest>(cfg);
+    runBenchmark<SemaphoreTest>(cfg);
+    runBenchmark<BarrierTest<StdBarrier>>(cfg);
+    runBenchmark<BarrierTest<SenseReversingBarrier>>(cfg);
+    runBenchmark<BarrierTest<CombiningTreeBarrier>>(cfg);
+    runBenchmark<BarrierTest<SpinThenFutexBarrier>>(cfg);
+    runBenchmark<SpinLockTest>(cfg);
+    runBenchmark<LockTest<TTASBackoffLock>>(cfg);
+    runBenchmark<LockTest<TicketLock>>(cfg);
+    runBenchmark<LockTest<MCSLock>>(cfg);
+    runBenchmark<LockTest<CLHLock>>(cfg);
+    runBenchmark<LockTest<SpinThenParkLock>>(cfg);
+    runBenchmark<AtomicCounterTest<memory_order_relaxed>>(cfg);
+    runBenchmark<AtomicCounterTest<memory_order_seq_cst>>(cfg);
+    runBenchmark<ShardedCounterTest>(cfg);
+    runBenchmark<FlatCombiningCounterTest>(cfg);
+    runBenchmark<SpinWaitTest>(cfg);
+    runBenchmark<MonitorTest>(cfg);
+    runBenchmark<MpmcQueueTest>(cfg);
+    runBenchmark<SpscQueueTest>(cfg);
+    runBenchmark<ReadWriteTest<SharedMutexRw>>(cfg);
+    runBenchmark<ReadWriteTest<SeqLockRw>>(cfg);
+    runBenchmark<ReadWriteTest<BigReaderRw>>(cfg);
+    runBenchmark<ReadWriteTest<EpochRcuRw>>(cfg);
+
     cout << "> COMPARISON\n";
-    sort(all_results.begin(), all_results.end(), [](const TestResult& a, const TestResult& b) {
-        return a.avg_time < b.avg_time;
+    stable_sort(all_results.begin(), all_results.end(), [](const TestResult& a, const TestResult& b) {
+        // Сценарии выполняют разное число операций, поэтому ранжируем по пропускной способности
+        return tie(a.threads, a.iterations, b.ops_per_sec) < tie(b.threads, b.iterations, a.ops_per_sec);
     });
-    
-    for (size_t i = 0; i < all_results.size(); ++i) {
-        cout << (i+1) << ". " << all_results[i].name << ": (avg) " << all_results[i].avg_time << " ms\n";
+
+    for (size_t i = 0, rank = 1; i < all_results.size(); ++i, ++rank) {
+        const auto& r = all_results[i];
+        if (i == 0 || r.threads != all_results[i - 1].threads || r.iterations != all_results[i - 1].iterations) {
+            cout << "Threads: " << r.threads << " | Iterations: " << r.iterations << "\n";
+            rank = 1;
+        }
+        cout << "  " << rank << ". " << displayName(r) << ": (median) " << r.median_ns << " ns, "
+             << fixed << setprecision(0) << r.ops_per_sec << " ops/s";
+
+        // Ускорение относительно MUTEX при тех же параметрах
+        auto mutex_it = find_if(all_results.begin(), all_results.end(), [&](const TestResult& m) {
+            return m.name == MutexTest::NAME && m.threads == r.threads && m.iterations == r.iterations;
+        });
+        if (mutex_it != all_results.end() && r.ops_per_sec > 0) {
+            cout << ", " << setprecision(2) << r.ops_per_sec / mutex_it->ops_per_sec << "x vs MUTEX";
+        }
+        if (!r.count_ok) cout << " [COUNT MISMATCH]";
+        cout << "\n";
     }
-    
+
+    if (!cfg.json_path.empty() && !writeJson(cfg.json_path, host, cfg)) {
+        cerr << "Cannot write JSON results to " << cfg.json_path << "\n";
+    }
+    if (!cfg.csv_path.empty() && !writeCsv(cfg.csv_path, host)) {
+        cerr << "Cannot write CSV results to " << cfg.csv_path << "\n";
+    }
+
+    int regressions = 0;
+    if (!baseline.empty()) {
+        cout << "\n";
+        regressions = compareWithBaseline(baseline, cfg.threshold_pct);
+    }
+
+    // Неверный счёт важнее регрессии: результаты такого прогона нельзя сравнивать
+    bool all_counts_ok = all_of(all_results.begin(), all_results.end(), [](const TestResult& r) {
+        return r.count_ok;
+    });
+    if (!all_counts_ok) return 3;
+    if (regressions > 0) return 2;
+
     return 0;
 }
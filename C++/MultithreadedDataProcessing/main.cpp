@@ -2,166 +2,1741 @@
 #include <vector>
 #include <string>
 #include <thread>
-#include <mutex>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <chrono>
 #include <iomanip>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include <map>
+#include <set>
+#include <deque>
+#include <tuple>
+#include <unordered_map>
+#include <string_view>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <random>
+#include <fstream>
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <bit>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../Common/topology.hpp"
 
 using namespace std;
 
-struct Employee {
-    string name;
-    string position;
-    string department;
-    double salary;
+struct Employee {
+    string name;
+    string position;
+    string department;
+    double salary;
+};
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+    int fd = -1;
+    const char* ptr = nullptr;
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const string& path) {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open " + path);
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw runtime_error("cannot stat " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw runtime_error("cannot map " + path);
+            }
+            ptr = static_cast<const char*>(p);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (ptr) munmap(const_cast<char*>(ptr), length);
+        if (fd >= 0) close(fd);
+    }
+
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+
+    void adviseSequential() const {
+        if (ptr) madvise(const_cast<char*>(ptr), length, MADV_SEQUENTIAL);
+    }
+
+    // Прочитанный участок больше не нужен: страницы уходят из памяти процесса
+    // и при следующем обращении будут снова прочитаны из файла
+    void release(size_t offset, size_t bytes) const {
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t begin = (offset + page - 1) / page * page;
+        size_t end = min(length, offset + bytes) / page * page;
+        if (ptr && end > begin) madvise(const_cast<char*>(ptr) + begin, end - begin, MADV_DONTNEED);
+    }
+};
+
+// Непрерывный столбец: собственный вектор или участок чужой памяти
+// (отображённого файла), который должен пережить столбец
+template <class T>
+class Column {
+    vector<T> owned;
+    const T* ptr = nullptr;
+    size_t count = 0;
+    bool viewing = false;
+
+    void sync() {
+        ptr = owned.data();
+        count = owned.size();
+    }
+
+    // У столбца-участка owned пуст: запись в него незаметно подменила бы чужие данные
+    void requireOwned() const {
+        if (viewing) throw logic_error("cannot modify a column that views foreign memory");
+    }
+
+public:
+    Column() = default;
+    Column(initializer_list<T> values) : owned(values) { sync(); }
+
+    static Column view(const T* data, size_t n) {
+        Column c;
+        c.ptr = data;
+        c.count = n;
+        c.viewing = true;
+        return c;
+    }
+
+    Column(const Column& other) : owned(other.owned), viewing(other.viewing) {
+        if (viewing) {
+            ptr = other.ptr;
+            count = other.count;
+        } else {
+            sync();
+        }
+    }
+
+    // Буфер вектора при перемещении не меняется, поэтому указатель остаётся верным
+    Column(Column&& other) noexcept
+        : owned(move(other.owned)), ptr(other.ptr), count(other.count), viewing(other.viewing) {
+        other.ptr = nullptr;
+        other.count = 0;
+    }
+
+    Column& operator=(Column other) noexcept {
+        swap(owned, other.owned);
+        swap(ptr, other.ptr);
+        swap(count, other.count);
+        swap(viewing, other.viewing);
+        return *this;
+    }
+
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool isView() const { return viewing; }
+
+    // Изменять можно только собственный столбец
+    T* mutableData() {
+        requireOwned();
+        return owned.data();
+    }
+
+    void push_back(const T& value) {
+        requireOwned();
+        owned.push_back(value);
+        sync();
+    }
+
+    void append(const T* values, size_t n) {
+        requireOwned();
+        owned.insert(owned.end(), values, values + n);
+        sync();
+    }
+
+    void resize(size_t n) {
+        requireOwned();
+        owned.resize(n);
+        sync();
+    }
+
+    void reserve(size_t n) {
+        requireOwned();
+        owned.reserve(n);
+        sync();
+    }
+
+    void clear() {
+        requireOwned();
+        owned.clear();
+        sync();
+    }
+};
+
+// Строки столбца, закодированные номерами. Байты всех строк лежат подряд в одной арене,
+// строка id занимает arena[offsets[id], offsets[id + 1]).
+class StringPool {
+    // Прозрачный хеш: поиск по string_view без временной string
+    struct ViewHash {
+        using is_transparent = void;
+        size_t operator()(string_view s) const { return hash<string_view>{}(s); }
+    };
+
+    unordered_map<string, uint32_t, ViewHash, equal_to<>> ids;  // только для intern, заполняется при загрузке
+
+public:
+    Column<char> arena;
+    Column<uint64_t> offsets = {0};
+
+    StringPool() = default;
+
+    // Словарь поверх чужой памяти: strings строк, offsets из strings + 1 элементов
+    static StringPool view(const char* bytes, size_t byte_count, const uint64_t* offsets, size_t strings) {
+        StringPool pool;
+        pool.arena = Column<char>::view(bytes, byte_count);
+        pool.offsets = Column<uint64_t>::view(offsets, strings + 1);
+        return pool;
+    }
+
+    // Номер строки s; одинаковые строки получают один номер
+    uint32_t intern(string_view s) {
+        // у словаря поверх файла ids пуст: номера выдавались бы повторно
+        if (arena.isView()) throw logic_error("cannot intern into a string pool that views foreign memory");
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        uint32_t id = append(s);
+        ids.emplace(s, id);
+        return id;
+    }
+
+    // Добавляет строку без поиска повторов (для уникальных значений вроде ФИО)
+    uint32_t append(string_view s) {
+        arena.append(s.data(), s.size());
+        offsets.push_back(arena.size());
+        return static_cast<uint32_t>(offsets.size() - 2);
+    }
+
+    string_view get(uint32_t id) const {
+        return string_view(arena.data() + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    size_t size() const { return offsets.size() - 1; }
+
+    void reserve(size_t strings, size_t bytes) {
+        offsets.reserve(strings + 1);
+        arena.reserve(bytes);
+    }
+
+    void clear() {
+        ids.clear();
+        arena.clear();
+        offsets = {0};
+    }
+};
+
+// Номер значения в словаре отдела или должности
+using DictId = uint16_t;
+
+inline DictId dictId(uint32_t id) {
+    if (id > numeric_limits<DictId>::max()) throw length_error("too many distinct dictionary values");
+    return static_cast<DictId>(id);
+}
+
+// Столбец-ключ группировки: номера значений и размер словаря
+struct KeyColumn {
+    const Column<DictId>* ids;
+    size_t cardinality;
+};
+
+// Сотрудники по столбцам: проходы агрегации и фильтрации читают только salary и
+// номера отделов, строки нужны лишь для вывода. Столбцы либо собственные, либо
+// смотрят в отображённый колоночный файл, который тогда держит mapping.
+struct EmployeeTable {
+    Column<double> salary;
+    Column<DictId> department;
+    Column<DictId> position;
+    Column<uint32_t> name;
+    StringPool departments;
+    StringPool positions;
+    StringPool names;
+    shared_ptr<const MappedFile> mapping;
+
+    size_t size() const { return salary.size(); }
+
+    void reserve(size_t rows) {
+        salary.reserve(rows);
+        department.reserve(rows);
+        position.reserve(rows);
+        name.reserve(rows);
+    }
+
+    void append(string_view name_value, string_view position_value, string_view department_value,
+                double salary_value) {
+        salary.push_back(salary_value);
+        department.push_back(dictId(departments.intern(department_value)));
+        position.push_back(dictId(positions.intern(position_value)));
+        name.push_back(names.append(name_value));
+    }
+
+    Employee row(size_t i) const {
+        return {string(names.get(name[i])), string(positions.get(position[i])),
+                string(departments.get(department[i])), salary[i]};
+    }
+
+    KeyColumn departmentKey() const { return {&department, departments.size()}; }
+    KeyColumn positionKey() const { return {&position, positions.size()}; }
+
+    // Убирает строки, словари отделов и должностей сохраняются
+    void clearRows() {
+        salary.clear();
+        department.clear();
+        position.clear();
+        name.clear();
+        names.clear();
+    }
+};
+
+// Сумма и количество — всё, что нужно для среднего
+struct SumCount {
+    double sum = 0;
+    size_t count = 0;
+
+    void add(double x) {
+        sum += x;
+        ++count;
+    }
+
+    void merge(const SumCount& other) {
+        sum += other.sum;
+        count += other.count;
+    }
+
+    double mean() const { return count ? sum / count : 0.0; }
+};
+
+// Среднее и дисперсия по Уэлфорду плюс min/max; слияние — формула Чана
+struct FullStats {
+    size_t count = 0;
+    double avg = 0;
+    double m2 = 0;  // сумма квадратов отклонений от среднего
+    double min = numeric_limits<double>::infinity();
+    double max = -numeric_limits<double>::infinity();
+
+    void add(double x) {
+        ++count;
+        double delta = x - avg;
+        avg += delta / count;
+        m2 += delta * (x - avg);
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    void merge(const FullStats& other) {
+        if (!other.count) return;
+        size_t total = count + other.count;
+        double delta = other.avg - avg;
+        avg += delta * other.count / total;
+        m2 += other.m2 + delta * delta * count * other.count / total;
+        count = total;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+
+    double mean() const { return avg; }
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+};
+
+// Группировка по одному или нескольким словарным столбцам за один проход.
+// Составной ключ — смешанная система счисления по размерам словарей, группы лежат
+// в плоском массиве, поэтому строка стоит одного индексирования без поиска.
+template <class Accumulator>
+class GroupBy {
+    vector<KeyColumn> keys;
+    vector<Accumulator> groups;
+
+public:
+    GroupBy() = default;
+
+    explicit GroupBy(vector<KeyColumn> key_columns) : keys(move(key_columns)) {
+        size_t total = 1;
+        for (const auto& k : keys) total *= max<size_t>(k.cardinality, 1);
+        groups.resize(total);
+    }
+
+    size_t groupOf(size_t row) const {
+        size_t g = 0;
+        for (const auto& k : keys) g = g * k.cardinality + (*k.ids)[row];
+        return g;
+    }
+
+    // Добавляет строки [begin, end) столбца measure
+    void add(const Column<double>& measure, size_t begin, size_t end) {
+        if (keys.size() == 1) {
+            const DictId* ids = keys[0].ids->data();
+            for (size_t i = begin; i < end; ++i) groups[ids[i]].add(measure[i]);
+            return;
+        }
+        for (size_t i = begin; i < end; ++i) groups[groupOf(i)].add(measure[i]);
+    }
+
+    void merge(const GroupBy& other) {
+        for (size_t g = 0; g < groups.size(); ++g) groups[g].merge(other.groups[g]);
+    }
+
+    size_t size() const { return groups.size(); }
+    const Accumulator& operator[](size_t group) const { return groups[group]; }
+
+    // Номера значений ключевых столбцов группы, в порядке столбцов
+    vector<DictId> decode(size_t group) const {
+        vector<DictId> ids(keys.size());
+        for (size_t k = keys.size(); k-- > 0;) {
+            ids[k] = static_cast<DictId>(group % keys[k].cardinality);
+            group /= keys[k].cardinality;
+        }
+        return ids;
+    }
+};
+
+// Древовидное слияние частичных результатов потоков без общего лока.
+// Поток t вливает в свой результат результаты потоков t + 1, t + 2, t + 4, ...,
+// пока t делится на удвоенный шаг, и затем отмечается готовым. Глубина слияния —
+// log2(потоков), итог оказывается у потока 0. Каждый слот в своей кэш-линии.
+template <class T>
+class TreeReducer {
+    struct alignas(64) Slot {
+        T value;
+        atomic<bool> done{false};
+    };
+    vector<Slot> slots;
+
+public:
+    explicit TreeReducer(int threads) : slots(threads) {}
+
+    void reduce(int t, T&& partial) {
+        Slot& mine = slots[t];
+        mine.value = move(partial);
+        const int n = static_cast<int>(slots.size());
+        for (int step = 1; step < n && t % (2 * step) == 0; step *= 2) {
+            if (t + step >= n) continue;
+            Slot& other = slots[t + step];
+            other.done.wait(false, memory_order_acquire);
+            mine.value.merge(other.value);
+        }
+        mine.done.store(true, memory_order_release);
+        mine.done.notify_one();
+    }
+
+    // Итог; читать после завершения всех потоков
+    T& result() { return slots[0].value; }
+};
+
+// Сотрудник как ссылка на строку таблицы: поля читаются из столбцов по запросу,
+// ничего не копируется. Действительна, пока жива таблица.
+class EmployeeRef {
+    const EmployeeTable* table;
+    uint32_t row;
+
+public:
+    EmployeeRef(const EmployeeTable& table, uint32_t row) : table(&table), row(row) {}
+
+    string_view name() const { return table->names.get(table->name[row]); }
+    string_view position() const { return table->positions.get(table->position[row]); }
+    string_view department() const { return table->departments.get(table->department[row]); }
+    double salary() const { return table->salary[row]; }
+    uint32_t rowId() const { return row; }
+
+    // Копия полей, когда она действительно нужна
+    Employee materialize() const { return table->row(row); }
+};
+
+// Отобранные строки таблицы: только номера строк поверх исходных столбцов
+class EmployeeSelection {
+    const EmployeeTable* table = nullptr;
+    vector<uint32_t> rows;
+
+public:
+    class iterator {
+        const EmployeeTable* table;
+        const uint32_t* it;
+
+    public:
+        iterator(const EmployeeTable* table, const uint32_t* it) : table(table), it(it) {}
+        EmployeeRef operator*() const { return {*table, *it}; }
+        iterator& operator++() {
+            ++it;
+            return *this;
+        }
+        bool operator!=(const iterator& other) const { return it != other.it; }
+    };
+
+    EmployeeSelection() = default;
+    EmployeeSelection(const EmployeeTable& table, vector<uint32_t> rows) : table(&table), rows(move(rows)) {}
+
+    size_t size() const { return rows.size(); }
+    bool empty() const { return rows.empty(); }
+    EmployeeRef operator[](size_t k) const { return {*table, rows[k]}; }
+    const vector<uint32_t>& rowIds() const { return rows; }
+
+    iterator begin() const { return {table, rows.data()}; }
+    iterator end() const { return {table, rows.data() + rows.size()}; }
+};
+
+// Ядра фильтра "зарплата выше порога своего отдела": пишут в out номера подходящих
+// строк из [begin, end) по возрастанию и возвращают их количество. Порог отдела
+// берётся из threshold по номеру отдела. out должен вмещать end - begin + SELECT_SLACK
+// элементов: векторные ядра пишут по 8 номеров за раз, даже если подошли не все.
+constexpr size_t SELECT_SLACK = 8;
+
+using SelectKernel = size_t (*)(const double* salary, const DictId* department, const double* threshold,
+                                size_t begin, size_t end, uint32_t* out);
+
+size_t selectAboveScalar(const double* salary, const DictId* department, const double* threshold,
+                         size_t begin, size_t end, uint32_t* out) {
+    size_t n = 0;
+    for (size_t i = begin; i < end; ++i) {
+        out[n] = static_cast<uint32_t>(i);
+        n += salary[i] > threshold[department[i]];  // без ветвления: запись всегда, сдвиг по условию
+    }
+    return n;
+}
+
+#if defined(__x86_64__)
+// Перестановки для сжатия 8 номеров по 8-битной маске: LUT[m] ставит выбранные полосы в начало
+struct CompressTable {
+    alignas(32) uint32_t lanes[256][8];
+
+    CompressTable() {
+        for (int m = 0; m < 256; ++m) {
+            int n = 0;
+            for (int b = 0; b < 8; ++b) {
+                if (m & (1 << b)) lanes[m][n++] = b;
+            }
+            while (n < 8) lanes[m][n++] = 0;
+        }
+    }
+};
+const CompressTable compress_table;
+
+// AVX2: 8 строк за итерацию — две пары по 4 double, пороги собираются gather'ом,
+// номера подходящих строк сжимаются перестановкой по таблице
+__attribute__((target("avx2,popcnt")))
+size_t selectAboveAvx2(const double* salary, const DictId* department, const double* threshold,
+                       size_t begin, size_t end, uint32_t* out) {
+    size_t n = 0;
+    size_t i = begin;
+    const __m256i step = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (; i + 8 <= end; i += 8) {
+        __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(department + i));
+        __m128i ids_lo = _mm_cvtepu16_epi32(ids);
+        __m128i ids_hi = _mm_cvtepu16_epi32(_mm_srli_si128(ids, 8));
+        __m256d t_lo = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), threshold, ids_lo, all, 8);
+        __m256d t_hi = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), threshold, ids_hi, all, 8);
+        __m256d s_lo = _mm256_loadu_pd(salary + i);
+        __m256d s_hi = _mm256_loadu_pd(salary + i + 4);
+        unsigned mask = _mm256_movemask_pd(_mm256_cmp_pd(s_lo, t_lo, _CMP_GT_OQ)) |
+                        _mm256_movemask_pd(_mm256_cmp_pd(s_hi, t_hi, _CMP_GT_OQ)) << 4;
+        __m256i rows = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), step);
+        __m256i perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(compress_table.lanes[mask]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + n), _mm256_permutevar8x32_epi32(rows, perm));
+        n += __builtin_popcount(mask);
+    }
+    return n + selectAboveScalar(salary, department, threshold, i, end, out + n);
+}
+
+// AVX-512: 8 строк за итерацию, сжатие номеров — compress-store по маске сравнения
+__attribute__((target("avx512f,avx512vl,popcnt")))
+size_t selectAboveAvx512(const double* salary, const DictId* department, const double* threshold,
+                         size_t begin, size_t end, uint32_t* out) {
+    size_t n = 0;
+    size_t i = begin;
+    const __m256i step = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (; i + 8 <= end; i += 8) {
+        __m256i ids = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(department + i)));
+        __m512d t = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, ids, threshold, 8);
+        __mmask8 mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(salary + i), t, _CMP_GT_OQ);
+        __m256i rows = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), step);
+        _mm256_mask_compressstoreu_epi32(out + n, mask, rows);
+        n += __builtin_popcount(mask);
+    }
+    return n + selectAboveScalar(salary, department, threshold, i, end, out + n);
+}
+#endif
+
+struct SelectKernelInfo {
+    SelectKernel fn;
+    const char* name;
+};
+
+// Лучшее ядро для процессора, на котором запущена программа; выбирается один раз
+const SelectKernelInfo& selectKernel() {
+    static const SelectKernelInfo kernel = []() -> SelectKernelInfo {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")) {
+            return {selectAboveAvx512, "avx512"};
+        }
+        if (__builtin_cpu_supports("avx2")) return {selectAboveAvx2, "avx2"};
+#endif
+        return {selectAboveScalar, "scalar"};
+    }();
+    return kernel;
+}
+
+// Номера строк [begin, end) с зарплатой выше средней по отделу
+size_t selectAboveAverage(const EmployeeTable& employees, const vector<double>& dept_avg,
+                          size_t begin, size_t end, uint32_t* out) {
+    return selectKernel().fn(employees.salary.data(), employees.department.data(), dept_avg.data(),
+                             begin, end, out);
+}
+
+// Кусок входа, который поток обрабатывает за раз: строки [begin, end)
+struct Morsel {
+    size_t index;
+    size_t begin;
+    size_t end;
+    int worker;
+};
+
+// Пул потоков с перехватом работы. Потоки создаются один раз; каждый вызов parallelFor
+// делит строки на морсели и раздаёт их потокам непрерывными диапазонами. Владелец берёт
+// морсели с начала своего диапазона, освободившийся поток забирает у другого половину
+// остатка с конца. Диапазон очереди — пара (начало, конец) в одном 64-битном слове,
+// и владелец, и перехватчик меняют его через CAS.
+class WorkStealingPool {
+    static constexpr size_t MORSELS_PER_WORKER = 16;
+    static constexpr size_t MIN_MORSEL = 2048;
+    static constexpr size_t MAX_MORSEL = 1 << 16;
+
+    struct alignas(64) Queue {
+        atomic<uint64_t> range{0};
+    };
+
+    struct Job {
+        size_t rows = 0;
+        size_t morsel = 1;
+        const function<void(const Morsel&)>* body = nullptr;
+        const function<void(int)>* finish = nullptr;  // вызывается потоком, когда работы не осталось
+    };
+
+    vector<Queue> queues;
+    vector<thread> workers;
+    Job job;
+    alignas(64) atomic<uint64_t> generation{0};
+    alignas(64) atomic<int> running{0};
+    atomic<size_t> steals{0};
+    atomic<bool> stopping{false};
+    int pin_failures = 0;
+
+    static uint64_t pack(uint32_t first, uint32_t last) { return (uint64_t(first) << 32) | last; }
+
+    bool popFront(int w, uint32_t& m) {
+        uint64_t r = queues[w].range.load(memory_order_relaxed);
+        for (;;) {
+            uint32_t first = r >> 32, last = uint32_t(r);
+            if (first >= last) return false;
+            if (queues[w].range.compare_exchange_weak(r, pack(first + 1, last), memory_order_acq_rel)) {
+                m = first;
+                return true;
+            }
+        }
+    }
+
+    // Забирает половину остатка у первого потока с работой; один морсель сразу
+    // отдаётся вызывающему, остальные становятся его диапазоном
+    bool steal(int w, uint32_t& m) {
+        const int n = static_cast<int>(queues.size());
+        for (int k = 1; k < n; ++k) {
+            Queue& victim = queues[(w + k) % n];
+            uint64_t r = victim.range.load(memory_order_relaxed);
+            for (;;) {
+                uint32_t first = r >> 32, last = uint32_t(r);
+                if (first >= last) break;
+                uint32_t take = (last - first + 1) / 2;
+                if (victim.range.compare_exchange_weak(r, pack(first, last - take), memory_order_acq_rel)) {
+                    m = last - take;
+                    queues[w].range.store(pack(m + 1, last), memory_order_release);
+                    steals.fetch_add(1, memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void runMorsels(int w) {
+        uint32_t m;
+        while (popFront(w, m) || steal(w, m)) {
+            size_t begin = m * job.morsel;
+            (*job.body)({m, begin, min(job.rows, begin + job.morsel), w});
+        }
+        if (job.finish) (*job.finish)(w);
+    }
+
+    void workerLoop(int w) {
+        uint64_t seen = 0;
+        for (;;) {
+            generation.wait(seen, memory_order_acquire);
+            seen = generation.load(memory_order_acquire);
+            if (stopping.load(memory_order_relaxed)) return;
+            runMorsels(w);
+            if (running.fetch_sub(1, memory_order_acq_rel) == 1) running.notify_one();
+        }
+    }
+
+    void run(size_t rows, size_t grain, const function<void(const Morsel&)>& body,
+             const function<void(int)>* finish) {
+        const size_t n = queues.size();
+        job = {rows, morselSize(rows, grain), &body, finish};
+        size_t count = morselCount(rows, grain);
+        for (size_t w = 0; w < n; ++w) {
+            queues[w].range.store(pack(count * w / n, count * (w + 1) / n), memory_order_relaxed);
+        }
+        running.store(static_cast<int>(n), memory_order_relaxed);
+        generation.fetch_add(1, memory_order_release);
+        generation.notify_all();
+        for (int r; (r = running.load(memory_order_acquire)) != 0;) running.wait(r, memory_order_acquire);
+    }
+
+public:
+    // plan — процессор для каждого потока (пусто — без закрепления)
+    // Потоки закрепляются отсюда же, чтобы неудачи были известны до первого задания
+    WorkStealingPool(int threads, const vector<int>& plan) : queues(threads) {
+        for (int w = 0; w < threads; ++w) {
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, w);
+            if (!plan.empty() && !pinThread(workers.back().native_handle(), plan[w])) ++pin_failures;
+        }
+        if (pin_failures) {
+            cerr << "Предупреждение: не удалось закрепить потоков: " << pin_failures << " из " << threads << "\n";
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        stopping.store(true, memory_order_relaxed);
+        generation.fetch_add(1, memory_order_release);
+        generation.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    int size() const { return static_cast<int>(queues.size()); }
+
+    // Морселей столько, чтобы на поток пришлось около MORSELS_PER_WORKER,
+    // но не мельче MIN_MORSEL строк и не крупнее MAX_MORSEL. grain задаёт размер явно —
+    // для крупных заданий, где элемент не строка, а, например, кусок файла.
+    size_t morselSize(size_t rows, size_t grain = 0) const {
+        if (grain) return grain;
+        return clamp<size_t>(rows / (queues.size() * MORSELS_PER_WORKER), MIN_MORSEL, MAX_MORSEL);
+    }
+
+    size_t morselCount(size_t rows, size_t grain = 0) const {
+        return (rows + morselSize(rows, grain) - 1) / morselSize(rows, grain);
+    }
+
+    // Строки, которые поток w получает до перехватов
+    pair<size_t, size_t> homeRows(size_t rows, int w) const {
+        size_t count = morselCount(rows), morsel = morselSize(rows), n = queues.size();
+        return {min(rows, count * w / n * morsel), min(rows, count * (w + 1) / n * morsel)};
+    }
+
+    // Сколько потоков не удалось закрепить по плану
+    int pinFailures() const { return pin_failures; }
+
+    // Сколько раз потоки перехватывали работу с момента создания пула
+    size_t stealCount() const { return steals.load(memory_order_relaxed); }
+
+    void parallelFor(size_t rows, const function<void(const Morsel&)>& body, size_t grain = 0) {
+        if (rows) run(rows, grain, body, nullptr);
+    }
+
+    // Каждый поток копит свой частичный результат (make() при первом морселе),
+    // частичные результаты сливаются через TreeReducer
+    template <class T>
+    T parallelReduce(size_t rows, const function<T()>& make, const function<void(T&, const Morsel&)>& body) {
+        TreeReducer<T> reducer(size());
+        vector<unique_ptr<T>> partials(size());
+        function<void(const Morsel&)> each = [&](const Morsel& m) {
+            auto& local = partials[m.worker];
+            if (!local) local = make_unique<T>(make());
+            body(*local, m);
+        };
+        function<void(int)> finish = [&](int w) {
+            reducer.reduce(w, partials[w] ? move(*partials[w]) : make());
+        };
+        run(rows, 0, each, &finish);
+        return move(reducer.result());
+    }
+};
+
+// Время фаз обработки в наносекундах
+struct PhaseTimes {
+    size_t group_ns = 0;    // суммы и количества по отделам
+    size_t average_ns = 0;  // средние по отделам
+    size_t filter_ns = 0;   // отбор строк выше среднего
+    size_t merge_ns = 0;    // сборка номеров отобранных строк в один результат
+};
+
+// Секундомер фаз: lap() возвращает время с предыдущей отметки
+class PhaseClock {
+    chrono::high_resolution_clock::time_point last = chrono::high_resolution_clock::now();
+
+public:
+    size_t lap() {
+        auto now = chrono::high_resolution_clock::now();
+        size_t ns = chrono::duration_cast<chrono::nanoseconds>(now - last).count();
+        last = now;
+        return ns;
+    }
+};
+
+struct ProcessResult {
+    EmployeeSelection employees_above_avg;  // строки по возрастанию, ссылаются на входную таблицу
+    map<string, double> dept_avg_salary;
+    chrono::nanoseconds execution_time;
+    PhaseTimes phases;
+    string placement = "none";  // политика и процессоры потоков
+    size_t steals = 0;          // перехваты морселей в многопоточной обработке
+};
+
+Topology topology;
+PinPolicy pin_policy = PinPolicy::NONE;
+
+// Привязывает к NUMA-узлу каждого закреплённого потока ту часть столбцов, которую он
+// получает до перехватов. Вызывается до замера, чтобы перенос страниц не попал во время обработки.
+void placeEmployees(const EmployeeTable& employees, const WorkStealingPool& pool, const vector<int>& plan) {
+    if (plan.empty() || topology.nodes() < 2) return;
+    for (int t = 0; t < pool.size(); ++t) {
+        auto [start_idx, end_idx] = pool.homeRows(employees.size(), t);
+        if (start_idx >= end_idx) continue;
+        int node = topology.nodeOf(plan[t]);
+        bindToNode(&employees.salary[start_idx], (end_idx - start_idx) * sizeof(double), node);
+        bindToNode(&employees.department[start_idx], (end_idx - start_idx) * sizeof(DictId), node);
+    }
+}
+
+// Параметры синтетических данных. Отделы и должности выбираются по одному закону:
+// CYCLIC — строка i попадает в группу i % groups (равные группы, как в исходном генераторе),
+// UNIFORM — случайно и равновероятно, ZIPF — группа k с весом 1 / (k + 1)^zipf_s.
+struct GeneratorSpec {
+    enum Distribution { CYCLIC, UNIFORM, ZIPF };
+
+    Distribution distribution = CYCLIC;
+    double zipf_s = 1.0;
+    size_t departments = 5;
+    size_t positions = 5;
+    uint64_t seed = 42;
+
+    string describe() const {
+        char s[32];
+        snprintf(s, sizeof(s), "%g", zipf_s);
+        string law = distribution == CYCLIC ? "cyclic" : distribution == UNIFORM ? "uniform" : "zipf:" + string(s);
+        return law + ", отделов " + to_string(departments) + ", должностей " + to_string(positions) +
+               ", seed " + to_string(seed);
+    }
+};
+
+// cyclic | uniform | zipf | zipf:S
+bool parseDistribution(const string& text, GeneratorSpec& spec) {
+    if (text == "cyclic") spec.distribution = GeneratorSpec::CYCLIC;
+    else if (text == "uniform") spec.distribution = GeneratorSpec::UNIFORM;
+    else if (text.rfind("zipf", 0) == 0) {
+        spec.distribution = GeneratorSpec::ZIPF;
+        if (text.size() > 4) {
+            if (text[4] != ':') return false;
+            auto [ptr, ec] = from_chars(text.data() + 5, text.data() + text.size(), spec.zipf_s);
+            if (ec != errc() || ptr != text.data() + text.size() || !(spec.zipf_s > 0)) return false;
+        }
+    } else return false;
+    return true;
+}
+
+// SplitMix64: одно слово состояния, поэтому генератор куска дёшево заводится от его номера
+class SplitMix64 {
+    uint64_t state;
+
+public:
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // [0, 1) с 53 значащими битами
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+};
+
+// Номер группы для строки. Для ZIPF таблица накопленных весов строится один раз
+class GroupSampler {
+    GeneratorSpec::Distribution distribution;
+    size_t groups;
+    vector<double> cdf;
+
+public:
+    GroupSampler(const GeneratorSpec& spec, size_t groups) : distribution(spec.distribution), groups(groups) {
+        if (distribution != GeneratorSpec::ZIPF) return;
+        cdf.resize(groups);
+        double total = 0;
+        for (size_t k = 0; k < groups; ++k) cdf[k] = total += pow(double(k + 1), -spec.zipf_s);
+        for (double& c : cdf) c /= total;
+    }
+
+    DictId sample(size_t row, SplitMix64& rng) const {
+        switch (distribution) {
+        case GeneratorSpec::CYCLIC: return static_cast<DictId>(row % groups);
+        case GeneratorSpec::UNIFORM: return static_cast<DictId>(rng.next() % groups);
+        default: {
+            size_t k = upper_bound(cdf.begin(), cdf.end(), rng.uniform()) - cdf.begin();
+            return static_cast<DictId>(min(k, groups - 1));
+        }
+        }
+    }
+};
+
+// Куски фиксированного размера с собственным зерном: данные зависят только от seed и
+// числа строк, но не от числа потоков и порядка, в котором куски достались потокам.
+constexpr size_t GENERATOR_CHUNK = 1 << 16;
+constexpr string_view GENERATOR_NAMES[] = {"sdf", "ewoic", "kekw", "fewv", "aew"};
+
+// Куда генератор пишет строки: столбцы таблицы или блоки отображённого файла.
+// name_offsets[0] заполняет вызывающий.
+struct GeneratorTarget {
+    double* salary;
+    DictId* department;
+    DictId* position;
+    uint32_t* name;
+    uint64_t* name_offsets;
+    char* name_bytes;
+};
+
+size_t decimalDigits(uint64_t v) {
+    size_t digits = 1;
+    while (v >= 10) v /= 10, ++digits;
+    return digits;
+}
+
+// Имя строки i — "# i" и одно из GENERATOR_NAMES
+size_t generatedNameLength(size_t i) {
+    return 2 + decimalDigits(i) + GENERATOR_NAMES[i % size(GENERATOR_NAMES)].size();
+}
+
+// Начало имён каждого куска в байтах; последний элемент — объём всех имён
+vector<uint64_t> generatedNameBases(size_t rows, WorkStealingPool& pool) {
+    size_t chunks = (rows + GENERATOR_CHUNK - 1) / GENERATOR_CHUNK;
+    vector<uint64_t> bases(chunks + 1, 0);
+    pool.parallelFor(chunks, [&](const Morsel& m) {
+        for (size_t c = m.begin; c < m.end; ++c) {
+            uint64_t bytes = 0;
+            for (size_t i = c * GENERATOR_CHUNK; i < min(rows, (c + 1) * GENERATOR_CHUNK); ++i) {
+                bytes += generatedNameLength(i);
+            }
+            bases[c + 1] = bytes;
+        }
+    }, 1);
+    partial_sum(bases.begin(), bases.end(), bases.begin());
+    return bases;
+}
+
+// Словари отделов и должностей: первые пять названий прежние, дальше нумерованные
+void generateDictionaries(const GeneratorSpec& spec, StringPool& departments, StringPool& positions) {
+    static const string dept_names[] = {"IT", "Sales", "HR", "Finance", "Marketing"};
+    static const string pos_names[] = {"Разработчик", "Менеджер", "Аналитик", "Дизайнер", "Тестировщик"};
+    for (size_t k = 0; k < spec.departments; ++k) {
+        dictId(departments.intern(k < size(dept_names) ? dept_names[k] : "Dept-" + to_string(k + 1)));
+    }
+    for (size_t k = 0; k < spec.positions; ++k) {
+        dictId(positions.intern(k < size(pos_names) ? pos_names[k] : "Position-" + to_string(k + 1)));
+    }
+}
+
+void generateRows(const GeneratorTarget& out, size_t rows, const GeneratorSpec& spec,
+                  const vector<uint64_t>& name_bases, WorkStealingPool& pool) {
+    GroupSampler departments(spec, spec.departments), positions(spec, spec.positions);
+    pool.parallelFor(name_bases.size() - 1, [&](const Morsel& m) {
+        for (size_t c = m.begin; c < m.end; ++c) {
+            SplitMix64 rng(spec.seed ^ (c * 0xD1B54A32D192ED03ull));
+            char* p = out.name_bytes + name_bases[c];
+            for (size_t i = c * GENERATOR_CHUNK; i < min(rows, (c + 1) * GENERATOR_CHUNK); ++i) {
+                out.salary[i] = 40000 + rng.uniform() * 110000;
+                out.department[i] = departments.sample(i, rng);
+                out.position[i] = positions.sample(i, rng);
+                out.name[i] = static_cast<uint32_t>(i);
+                *p++ = '#';
+                *p++ = ' ';
+                p = to_chars(p, p + 20, i).ptr;
+                string_view suffix = GENERATOR_NAMES[i % size(GENERATOR_NAMES)];
+                p = copy(suffix.begin(), suffix.end(), p);
+                out.name_offsets[i + 1] = p - out.name_bytes;
+            }
+        }
+    }, 1);
+}
+
+void checkGeneratorSpec(size_t rows, const GeneratorSpec& spec) {
+    if (rows > numeric_limits<uint32_t>::max()) throw length_error("too many rows for 32-bit row ids");
+    if (spec.departments == 0 || spec.positions == 0) throw invalid_argument("empty group dictionary");
+}
+
+// Таблица в памяти: столбцы размечаются один раз и заполняются потоками пула на месте
+EmployeeTable generateEmployees(size_t rows, const GeneratorSpec& spec, WorkStealingPool& pool) {
+    checkGeneratorSpec(rows, spec);
+    EmployeeTable employees;
+    generateDictionaries(spec, employees.departments, employees.positions);
+    vector<uint64_t> name_bases = generatedNameBases(rows, pool);
+
+    employees.salary.resize(rows);
+    employees.department.resize(rows);
+    employees.position.resize(rows);
+    employees.name.resize(rows);
+    employees.names.arena.resize(name_bases.back());
+    employees.names.offsets.resize(rows + 1);
+    generateRows({employees.salary.mutableData(), employees.department.mutableData(),
+                  employees.position.mutableData(), employees.name.mutableData(),
+                  employees.names.offsets.mutableData(), employees.names.arena.mutableData()},
+                 rows, spec, name_bases, pool);
+    return employees;
+}
+
+// Формат CSV: заголовок name,position,department,salary и по строке на сотрудника.
+// Поля без кавычек; запятые допустимы только в ФИО, поэтому поля разбираются справа.
+constexpr const char* CSV_HEADER = "name,position,department,salary";
+
+// Участок CSV, разобранный одним потоком. Номера отделов и должностей локальные —
+// индексы в departments/positions, которые смотрят прямо в отображённый файл
+struct CsvPartial {
+    vector<double> salary;
+    vector<DictId> department;
+    vector<DictId> position;
+    StringPool names;
+    vector<string_view> departments;
+    vector<string_view> positions;
+    size_t bad_lines = 0;
+};
+
+DictId localId(unordered_map<string_view, DictId>& ids, vector<string_view>& values, string_view s) {
+    auto it = ids.find(s);
+    if (it != ids.end()) return it->second;
+    DictId id = dictId(static_cast<uint32_t>(values.size()));
+    values.push_back(s);
+    ids.emplace(s, id);
+    return id;
+}
+
+// Разбирает строки [begin, end) без выделения памяти под поля: ключи словарей —
+// string_view в файл, ФИО копируются сразу в арену участка
+void parseCsvRange(const char* begin, const char* end, CsvPartial& out) {
+    unordered_map<string_view, DictId> dept_ids, pos_ids;
+    auto lastComma = [](const char* from, const char* to) -> const char* {
+        for (const char* p = to; p > from;) {
+            if (*--p == ',') return p;
+        }
+        return nullptr;
+    };
+
+    for (const char* line = begin; line < end;) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!eol) eol = end;
+        const char* stop = eol > line && eol[-1] == '\r' ? eol - 1 : eol;
+        const char* next = eol < end ? eol + 1 : end;
+        if (stop == line) {
+            line = next;
+            continue;
+        }
+
+        const char* c3 = lastComma(line, stop);
+        const char* c2 = c3 ? lastComma(line, c3) : nullptr;
+        const char* c1 = c2 ? lastComma(line, c2) : nullptr;
+        double salary = 0;
+        if (!c1 || from_chars(c3 + 1, stop, salary).ec != errc()) {
+            ++out.bad_lines;
+            line = next;
+            continue;
+        }
+        out.salary.push_back(salary);
+        out.department.push_back(localId(dept_ids, out.departments, string_view(c2 + 1, c3 - c2 - 1)));
+        out.position.push_back(localId(pos_ids, out.positions, string_view(c1 + 1, c2 - c1 - 1)));
+        out.names.append(string_view(line, c1 - line));
+        line = next;
+    }
+}
+
+// Начало данных: пропускает строку заголовка, если она есть
+size_t csvDataStart(const MappedFile& file) {
+    size_t header = strlen(CSV_HEADER);
+    if (file.size() >= header && memcmp(file.data(), CSV_HEADER, header) == 0) {
+        const char* nl = static_cast<const char*>(memchr(file.data(), '\n', file.size()));
+        return nl ? nl - file.data() + 1 : file.size();
+    }
+    return 0;
+}
+
+// Позиция сразу после конца строки, в которую попадает pos
+size_t nextLineStart(const MappedFile& file, size_t pos) {
+    if (pos == 0 || pos >= file.size()) return min(pos, file.size());
+    const char* nl = static_cast<const char*>(memchr(file.data() + pos - 1, '\n', file.size() - pos + 1));
+    return nl ? nl - file.data() + 1 : file.size();
+}
+
+// Дописывает в таблицу строки файла [begin, end): участки разбираются на пуле
+// параллельно, затем локальные номера переводятся в номера словарей таблицы и
+// столбцы копируются на свои места, тоже параллельно. Возвращает число плохих строк.
+size_t appendCsvRange(EmployeeTable& table, const MappedFile& file, size_t begin, size_t end,
+                      WorkStealingPool& pool) {
+    constexpr size_t PIECE_BYTES = 4 << 20;
+    size_t pieces = max<size_t>(pool.size() * 4, (end - begin) / PIECE_BYTES + 1);
+    pieces = min(pieces, max<size_t>(1, (end - begin) / 4096));
+    vector<size_t> bounds = {begin};
+    for (size_t k = 1; k < pieces; ++k) {
+        bounds.push_back(max(bounds.back(), nextLineStart(file, begin + (end - begin) * k / pieces)));
+    }
+    bounds.push_back(end);
+
+    vector<CsvPartial> parts(pieces);
+    pool.parallelFor(pieces, [&](const Morsel& m) {
+        for (size_t k = m.begin; k < m.end; ++k) {
+            parseCsvRange(file.data() + bounds[k], file.data() + bounds[k + 1], parts[k]);
+        }
+    }, 1);
+
+    // Словари маленькие, перевод номеров собирается последовательно
+    vector<vector<DictId>> dept_map(pieces), pos_map(pieces);
+    vector<size_t> row_base(pieces + 1, table.size()), byte_base(pieces + 1, table.names.arena.size());
+    size_t bad_lines = 0;
+    for (size_t k = 0; k < pieces; ++k) {
+        for (string_view v : parts[k].departments) dept_map[k].push_back(dictId(table.departments.intern(v)));
+        for (string_view v : parts[k].positions) pos_map[k].push_back(dictId(table.positions.intern(v)));
+        row_base[k + 1] = row_base[k] + parts[k].salary.size();
+        byte_base[k + 1] = byte_base[k] + parts[k].names.arena.size();
+        bad_lines += parts[k].bad_lines;
+    }
+
+    const size_t first_name = table.names.size();
+    const size_t first_row = row_base[0];
+    if (row_base[pieces] > numeric_limits<uint32_t>::max() ||
+        first_name + row_base[pieces] - first_row > numeric_limits<uint32_t>::max()) {
+        throw length_error("too many rows for 32-bit row ids");
+    }
+    table.salary.resize(row_base[pieces]);
+    table.department.resize(row_base[pieces]);
+    table.position.resize(row_base[pieces]);
+    table.name.resize(row_base[pieces]);
+    table.names.arena.resize(byte_base[pieces]);
+    table.names.offsets.resize(first_name + 1 + row_base[pieces] - first_row);
+
+    pool.parallelFor(pieces, [&](const Morsel& m) {
+        for (size_t k = m.begin; k < m.end; ++k) {
+            const CsvPartial& part = parts[k];
+            size_t base = row_base[k];
+            size_t name_base = first_name + base - first_row;
+            copy(part.salary.begin(), part.salary.end(), table.salary.mutableData() + base);
+            for (size_t i = 0; i < part.salary.size(); ++i) {
+                table.department.mutableData()[base + i] = dept_map[k][part.department[i]];
+                table.position.mutableData()[base + i] = pos_map[k][part.position[i]];
+                table.name.mutableData()[base + i] = static_cast<uint32_t>(name_base + i);
+                table.names.offsets.mutableData()[name_base + i + 1] = byte_base[k] + part.names.offsets[i + 1];
+            }
+            if (part.names.arena.size()) {
+                memcpy(table.names.arena.mutableData() + byte_base[k], part.names.arena.data(),
+                       part.names.arena.size());
+            }
+        }
+    }, 1);
+    return bad_lines;
+}
+
+EmployeeTable loadCsv(const string& path, WorkStealingPool& pool) {
+    auto file = make_shared<MappedFile>(path);
+    file->adviseSequential();
+    EmployeeTable table;
+    size_t bad_lines = appendCsvRange(table, *file, csvDataStart(*file), file->size(), pool);
+    if (bad_lines) cerr << "Пропущено некорректных строк: " << bad_lines << "\n";
+    return table;
+}
+
+void writeCsv(const string& path, const EmployeeTable& employees) {
+    ofstream out(path);
+    if (!out) throw runtime_error("cannot write " + path);
+    out << CSV_HEADER << "\n" << fixed << setprecision(2);
+    for (size_t i = 0; i < employees.size(); ++i) {
+        out << employees.names.get(employees.name[i]) << "," << employees.positions.get(employees.position[i])
+            << "," << employees.departments.get(employees.department[i]) << "," << employees.salary[i] << "\n";
+    }
+}
+
+// Колоночный файл: заголовок и блоки столбцов и словарей, каждый с границы COLUMNAR_ALIGN.
+// Отображается в память и обрабатывается как есть, без разбора. Порядок байтов — родной.
+constexpr char COLUMNAR_MAGIC[8] = {'E', 'M', 'P', 'C', 'O', 'L', '1', '\0'};
+constexpr size_t COLUMNAR_ALIGN = 64;
+
+enum ColumnarBlock {
+    BLOCK_SALARY, BLOCK_DEPARTMENT, BLOCK_POSITION, BLOCK_NAME,
+    BLOCK_DEPT_OFFSETS, BLOCK_DEPT_BYTES, BLOCK_POS_OFFSETS, BLOCK_POS_BYTES,
+    BLOCK_NAME_OFFSETS, BLOCK_NAME_BYTES, BLOCK_COUNT
 };
 
-struct ProcessResult {
-    vector<Employee> employees_above_avg;
-    map<string, double> dept_avg_salary;
-    chrono::milliseconds execution_time;
+struct ColumnarHeader {
+    char magic[8];
+    uint64_t rows;
+    struct {
+        uint64_t offset;
+        uint64_t bytes;
+    } blocks[BLOCK_COUNT];
 };
 
-vector<Employee> generateEmployees(int count) {
-    vector<Employee> employees;
-    vector<string> names = {"sdf", "ewoic", "kekw", "fewv", "aew"};
-    vector<string> positions = {"Разработчик", "Менеджер", "Аналитик", "Дизайнер", "Тестировщик"};
-    vector<string> departments = {"IT", "Sales", "HR", "Finance", "Marketing"};
-    
-    mt19937 gen(random_device{}());
-    uniform_real_distribution<> dis(40000, 150000);
-    
-    for (int i = 0; i < count; ++i) {
-        employees.push_back({
-            "# " + to_string(i) + names[i % names.size()],
-            positions[i % positions.size()],
-            departments[i % departments.size()],
-            dis(gen)
-        });
+// Заголовок с размещением блоков заданных размеров; конец последнего блока — размер файла
+ColumnarHeader columnarLayout(size_t rows, const size_t bytes[BLOCK_COUNT]) {
+    ColumnarHeader header{};
+    memcpy(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    header.rows = rows;
+    uint64_t offset = sizeof(header);
+    for (int b = 0; b < BLOCK_COUNT; ++b) {
+        offset = (offset + COLUMNAR_ALIGN - 1) / COLUMNAR_ALIGN * COLUMNAR_ALIGN;
+        header.blocks[b] = {offset, bytes[b]};
+        offset += bytes[b];
     }
-    return employees;
+    return header;
+}
+
+void writeColumnar(const string& path, const EmployeeTable& employees) {
+    auto bytesOf = [](const auto& column) {
+        return make_pair(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(column[0]));
+    };
+    pair<const char*, size_t> blocks[BLOCK_COUNT] = {
+        bytesOf(employees.salary), bytesOf(employees.department), bytesOf(employees.position),
+        bytesOf(employees.name),
+        bytesOf(employees.departments.offsets), bytesOf(employees.departments.arena),
+        bytesOf(employees.positions.offsets), bytesOf(employees.positions.arena),
+        bytesOf(employees.names.offsets), bytesOf(employees.names.arena),
+    };
+
+    size_t bytes[BLOCK_COUNT];
+    for (int b = 0; b < BLOCK_COUNT; ++b) bytes[b] = blocks[b].second;
+    ColumnarHeader header = columnarLayout(employees.size(), bytes);
+
+    ofstream out(path, ios::binary);
+    if (!out) throw runtime_error("cannot write " + path);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    const char zeros[COLUMNAR_ALIGN] = {};
+    for (int b = 0; b < BLOCK_COUNT; ++b) {
+        out.write(zeros, header.blocks[b].offset - written);
+        out.write(blocks[b].first, blocks[b].second);
+        written = header.blocks[b].offset + blocks[b].second;
+    }
+}
+
+// Блок колоночного файла как массив T из expected элементов
+template <class T>
+const T* columnarBlock(const MappedFile& file, const ColumnarHeader& header, ColumnarBlock b, size_t expected) {
+    if (header.blocks[b].bytes != expected * sizeof(T)) throw runtime_error("corrupt columnar block");
+    return reinterpret_cast<const T*>(file.data() + header.blocks[b].offset);
+}
+
+// Таблица прямо поверх отображённого колоночного файла, без копирования. Файл проверяется
+// целиком: разметка блоков, смещения словарей и номера в каждой строке, чтобы повреждённая
+// выгрузка отвергалась при загрузке, а не роняла обработку.
+EmployeeTable mapColumnar(const string& path) {
+    auto file = make_shared<MappedFile>(path);
+    ColumnarHeader header;
+    if (file->size() < sizeof(header)) throw runtime_error(path + ": not a columnar file");
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0) {
+        throw runtime_error(path + ": not a columnar file");
+    }
+    for (const auto& b : header.blocks) {
+        if (b.offset % COLUMNAR_ALIGN || b.offset > file->size() || b.bytes > file->size() - b.offset) {
+            throw runtime_error(path + ": corrupt block table");
+        }
+    }
+
+    auto dictionary = [&](ColumnarBlock offsets_block, ColumnarBlock bytes_block) {
+        if (header.blocks[offsets_block].bytes < sizeof(uint64_t)) throw runtime_error(path + ": corrupt dictionary");
+        size_t strings = header.blocks[offsets_block].bytes / sizeof(uint64_t) - 1;
+        const uint64_t* offsets = columnarBlock<uint64_t>(*file, header, offsets_block, strings + 1);
+        if (offsets[strings] != header.blocks[bytes_block].bytes) throw runtime_error(path + ": corrupt dictionary");
+        for (size_t i = 0; i < strings; ++i) {
+            if (offsets[i] > offsets[i + 1]) throw runtime_error(path + ": corrupt dictionary");
+        }
+        return StringPool::view(file->data() + header.blocks[bytes_block].offset,
+                                header.blocks[bytes_block].bytes, offsets, strings);
+    };
+
+    if (header.rows > file->size()) throw runtime_error(path + ": corrupt row count");
+    const size_t rows = header.rows;
+    EmployeeTable table;
+    table.salary = Column<double>::view(columnarBlock<double>(*file, header, BLOCK_SALARY, rows), rows);
+    table.department = Column<DictId>::view(columnarBlock<DictId>(*file, header, BLOCK_DEPARTMENT, rows), rows);
+    table.position = Column<DictId>::view(columnarBlock<DictId>(*file, header, BLOCK_POSITION, rows), rows);
+    table.name = Column<uint32_t>::view(columnarBlock<uint32_t>(*file, header, BLOCK_NAME, rows), rows);
+    table.departments = dictionary(BLOCK_DEPT_OFFSETS, BLOCK_DEPT_BYTES);
+    table.positions = dictionary(BLOCK_POS_OFFSETS, BLOCK_POS_BYTES);
+    table.names = dictionary(BLOCK_NAME_OFFSETS, BLOCK_NAME_BYTES);
+
+    const size_t departments = table.departments.size(), positions = table.positions.size();
+    const size_t names = table.names.size();
+    for (size_t i = 0; i < rows; ++i) {
+        if (table.department[i] >= departments) throw runtime_error(path + ": corrupt department id");
+        if (table.position[i] >= positions) throw runtime_error(path + ": corrupt position id");
+        if (table.name[i] >= names) throw runtime_error(path + ": corrupt name id");
+    }
+    table.mapping = file;
+    return table;
+}
+
+// Синтетические данные сразу в колоночный файл: файл размечается целиком, отображается
+// на запись, и потоки пула пишут строки прямо в его блоки. Таблица в памяти не собирается,
+// поэтому объём ограничен диском, а не памятью. Содержимое то же, что у generateEmployees.
+void generateColumnarFile(const string& path, size_t rows, const GeneratorSpec& spec, WorkStealingPool& pool) {
+    checkGeneratorSpec(rows, spec);
+    StringPool departments, positions;
+    generateDictionaries(spec, departments, positions);
+    vector<uint64_t> name_bases = generatedNameBases(rows, pool);
+
+    size_t bytes[BLOCK_COUNT] = {
+        rows * sizeof(double), rows * sizeof(DictId), rows * sizeof(DictId), rows * sizeof(uint32_t),
+        departments.offsets.size() * sizeof(uint64_t), departments.arena.size(),
+        positions.offsets.size() * sizeof(uint64_t), positions.arena.size(),
+        (rows + 1) * sizeof(uint64_t), name_bases.back(),
+    };
+    ColumnarHeader header = columnarLayout(rows, bytes);
+    size_t file_size = header.blocks[BLOCK_COUNT - 1].offset + header.blocks[BLOCK_COUNT - 1].bytes;
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw runtime_error("cannot write " + path);
+    if (ftruncate(fd, file_size) != 0) {
+        close(fd);
+        throw runtime_error("cannot allocate " + path);
+    }
+    void* mapped = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) throw runtime_error("cannot map " + path);
+    char* base = static_cast<char*>(mapped);
+    auto block = [&](ColumnarBlock b) { return base + header.blocks[b].offset; };
+
+    memcpy(base, &header, sizeof(header));
+    memcpy(block(BLOCK_DEPT_OFFSETS), departments.offsets.data(), bytes[BLOCK_DEPT_OFFSETS]);
+    memcpy(block(BLOCK_DEPT_BYTES), departments.arena.data(), bytes[BLOCK_DEPT_BYTES]);
+    memcpy(block(BLOCK_POS_OFFSETS), positions.offsets.data(), bytes[BLOCK_POS_OFFSETS]);
+    memcpy(block(BLOCK_POS_BYTES), positions.arena.data(), bytes[BLOCK_POS_BYTES]);
+    auto* name_offsets = reinterpret_cast<uint64_t*>(block(BLOCK_NAME_OFFSETS));
+    name_offsets[0] = 0;
+    generateRows({reinterpret_cast<double*>(block(BLOCK_SALARY)), reinterpret_cast<DictId*>(block(BLOCK_DEPARTMENT)),
+                  reinterpret_cast<DictId*>(block(BLOCK_POSITION)), reinterpret_cast<uint32_t*>(block(BLOCK_NAME)),
+                  name_offsets, block(BLOCK_NAME_BYTES)},
+                 rows, spec, name_bases, pool);
+    int synced = msync(mapped, file_size, MS_SYNC);
+    munmap(mapped, file_size);
+    if (synced != 0) throw runtime_error("cannot flush " + path);
+}
+
+// Средние по номерам отделов; в результат попадают под названиями отделов
+vector<double> departmentAverages(ProcessResult& result, const EmployeeTable& employees,
+                                  const GroupBy<SumCount>& by_dept) {
+    vector<double> avg(by_dept.size());
+    for (size_t d = 0; d < by_dept.size(); ++d) {
+        avg[d] = by_dept[d].mean();
+        if (by_dept[d].count) result.dept_avg_salary[string(employees.departments.get(d))] = avg[d];
+    }
+    return avg;
 }
 
-ProcessResult singleThreadProcess(const vector<Employee>& employees) {
+ProcessResult singleThreadProcess(const EmployeeTable& employees) {
     auto start = chrono::high_resolution_clock::now();
+    PhaseClock clock;
     
     ProcessResult result;
-    map<string, vector<double>> dept_salaries;
     
-    // зарплаты по отделам
-    for (const auto& emp : employees) {
-        dept_salaries[emp.department].push_back(emp.salary);
-    }
+    // сумма и количество зарплат по отделам за один проход
+    GroupBy<SumCount> by_dept({employees.departmentKey()});
+    by_dept.add(employees.salary, 0, employees.size());
+    result.phases.group_ns = clock.lap();
     
     // средняя зарплата по каждому отделу
-    for (auto& [dept, salaries] : dept_salaries) {
-        double avg = accumulate(salaries.begin(), salaries.end(), 0.0) / salaries.size();
-        result.dept_avg_salary[dept] = avg;
-    }
+    vector<double> dept_avg = departmentAverages(result, employees, by_dept);
+    result.phases.average_ns = clock.lap();
     
-    for (const auto& emp : employees) {
-        if (emp.salary > result.dept_avg_salary[emp.department]) {
-            result.employees_above_avg.push_back(emp);
-        }
-    }
+    vector<uint32_t> selection(employees.size() + SELECT_SLACK);
+    selection.resize(selectAboveAverage(employees, dept_avg, 0, employees.size(), selection.data()));
+    result.phases.filter_ns = clock.lap();
+    result.employees_above_avg = EmployeeSelection(employees, move(selection));
+    result.phases.merge_ns = clock.lap();
     
     auto end = chrono::high_resolution_clock::now();
-    result.execution_time = chrono::duration_cast<chrono::milliseconds>(end - start);
+    result.execution_time = chrono::duration_cast<chrono::nanoseconds>(end - start);
     
     return result;
 }
 
-ProcessResult multiThreadProcess(const vector<Employee>& employees, int num_threads) {
+// Обе фазы выполняются на пуле морселями; номера отобранных строк собираются по номерам
+// морселей, поэтому порядок сотрудников тот же, что при однопоточной обработке
+ProcessResult multiThreadProcess(const EmployeeTable& employees, WorkStealingPool& pool) {
     auto start = chrono::high_resolution_clock::now();
+    PhaseClock clock;
     
     ProcessResult result;
-    map<string, vector<double>> dept_salaries;
-    mutex dept_mutex;
+    const size_t rows = employees.size();
+    const size_t steals_before = pool.stealCount();
     
     // Параллельная группировка данных по отделам
-    int chunk_size = (employees.size() + num_threads - 1) / num_threads;
-    vector<thread> threads;
-    
-    for (int t = 0; t < num_threads; ++t) {
-        threads.emplace_back([t, chunk_size, &employees, &dept_salaries, &dept_mutex]() {
-            int start_idx = t * chunk_size;
-            int end_idx = min(start_idx + chunk_size, (int)employees.size());
-            
-            map<string, vector<double>> local_dept_salaries;
-            
-            // Локальная обработка данных
-            for (int i = start_idx; i < end_idx; ++i) {
-                local_dept_salaries[employees[i].department].push_back(employees[i].salary);
-            }
-            
-            // Объединение результатов
-            {
-                lock_guard<mutex> lock(dept_mutex);
-                for (auto& [dept, salaries] : local_dept_salaries) {
-                    dept_salaries[dept].insert(
-                        dept_salaries[dept].end(),
-                        salaries.begin(),
-                        salaries.end()
-                    );
-                }
-            }
-        });
-    }
-    
-    for (auto& t : threads) {
-        t.join();
-    }
+    GroupBy<SumCount> by_dept = pool.parallelReduce<GroupBy<SumCount>>(
+        rows,
+        [&]() { return GroupBy<SumCount>({employees.departmentKey()}); },
+        [&](GroupBy<SumCount>& local, const Morsel& m) { local.add(employees.salary, m.begin, m.end); });
+    result.phases.group_ns = clock.lap();
     
     // Вычисление средней зарплаты по отделам
-    for (auto& [dept, salaries] : dept_salaries) {
-        double avg = accumulate(salaries.begin(), salaries.end(), 0.0) / salaries.size();
-        result.dept_avg_salary[dept] = avg;
-    }
+    vector<double> dept_avg = departmentAverages(result, employees, by_dept);
+    result.phases.average_ns = clock.lap();
     
     // Параллельный поиск сотрудников выше среднего
-    vector<Employee> local_results[num_threads];
-    threads.clear();
-    
-    for (int t = 0; t < num_threads; ++t) {
-        threads.emplace_back([t, chunk_size, &employees, &result, &local_results]() {
-            int start_idx = t * chunk_size;
-            int end_idx = min(start_idx + chunk_size, (int)employees.size());
-            
-            for (int i = start_idx; i < end_idx; ++i) {
-                if (employees[i].salary > result.dept_avg_salary[employees[i].department]) {
-                    local_results[t].push_back(employees[i]);
-                }
-            }
-        });
-    }
-    
-    for (auto& t : threads) {
-        t.join();
-    }
+    vector<vector<uint32_t>> morsel_selections(pool.morselCount(rows));
+    pool.parallelFor(rows, [&](const Morsel& m) {
+        auto& sel = morsel_selections[m.index];
+        sel.resize(m.end - m.begin + SELECT_SLACK);
+        sel.resize(selectAboveAverage(employees, dept_avg, m.begin, m.end, sel.data()));
+    });
+    result.phases.filter_ns = clock.lap();
     
-    // Объединение результатов
-    for (int t = 0; t < num_threads; ++t) {
-        result.employees_above_avg.insert(
-            result.employees_above_avg.end(),
-            local_results[t].begin(),
-            local_results[t].end()
-        );
+    // Объединение результатов: только номера строк, поля сотрудников не копируются
+    size_t selected = 0;
+    for (const auto& sel : morsel_selections) selected += sel.size();
+    vector<uint32_t> selection;
+    selection.reserve(selected);
+    for (const auto& sel : morsel_selections) {
+        selection.insert(selection.end(), sel.begin(), sel.end());
     }
+    result.employees_above_avg = EmployeeSelection(employees, move(selection));
+    result.phases.merge_ns = clock.lap();
     
     auto end = chrono::high_resolution_clock::now();
-    result.execution_time = chrono::duration_cast<chrono::milliseconds>(end - start);
+    result.execution_time = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    result.steals = pool.stealCount() - steals_before;
     
     return result;
 }
 
+// Итог потоковой обработки: строки не хранятся, только агрегаты
+struct StreamResult {
+    map<string, double> dept_avg_salary;
+    size_t rows = 0;
+    size_t above_avg = 0;
+    size_t chunks = 0;
+    chrono::nanoseconds execution_time;
+};
+
+// Обходит CSV кусками примерно по chunk_bytes, выровненными по строкам. Каждый кусок
+// разбирается в chunk (словари общие для всех кусков), после обработки его страницы
+// отдаются обратно, так что в памяти одновременно только один кусок.
+void forEachCsvChunk(const MappedFile& file, size_t chunk_bytes, WorkStealingPool& pool, EmployeeTable& chunk,
+                     const function<void(const EmployeeTable&)>& fn) {
+    for (size_t pos = csvDataStart(file); pos < file.size();) {
+        size_t end = nextLineStart(file, min(file.size(), pos + chunk_bytes));
+        chunk.clearRows();
+        appendCsvRange(chunk, file, pos, end, pool);
+        fn(chunk);
+        file.release(pos, end - pos);
+        pos = end;
+    }
+}
+
+// Потоковая обработка CSV, который не помещается в память: первый проход считает
+// средние по отделам, второй — сколько сотрудников получают больше среднего
+StreamResult streamCsv(const string& path, WorkStealingPool& pool, size_t chunk_bytes) {
+    auto start = chrono::high_resolution_clock::now();
+    StreamResult result;
+    MappedFile file(path);
+    file.adviseSequential();
+    EmployeeTable chunk;
+
+    vector<SumCount> totals;
+    forEachCsvChunk(file, chunk_bytes, pool, chunk, [&](const EmployeeTable& c) {
+        GroupBy<SumCount> part = pool.parallelReduce<GroupBy<SumCount>>(
+            c.size(),
+            [&]() { return GroupBy<SumCount>({c.departmentKey()}); },
+            [&](GroupBy<SumCount>& local, const Morsel& m) { local.add(c.salary, m.begin, m.end); });
+        totals.resize(c.departments.size());
+        for (size_t d = 0; d < part.size(); ++d) totals[d].merge(part[d]);
+        result.rows += c.size();
+        ++result.chunks;
+    });
+
+    vector<double> dept_avg(totals.size());
+    for (size_t d = 0; d < totals.size(); ++d) {
+        dept_avg[d] = totals[d].mean();
+        if (totals[d].count) result.dept_avg_salary[string(chunk.departments.get(d))] = dept_avg[d];
+    }
+
+    forEachCsvChunk(file, chunk_bytes, pool, chunk, [&](const EmployeeTable& c) {
+        vector<size_t> counts(pool.morselCount(c.size()));
+        pool.parallelFor(c.size(), [&](const Morsel& m) {
+            vector<uint32_t> sel(m.end - m.begin + SELECT_SLACK);
+            counts[m.index] = selectAboveAverage(c, dept_avg, m.begin, m.end, sel.data());
+        });
+        result.above_avg += accumulate(counts.begin(), counts.end(), size_t{0});
+    });
+
+    auto end = chrono::high_resolution_clock::now();
+    result.execution_time = chrono::duration_cast<chrono::nanoseconds>(end - start);
+    return result;
+}
+
+// Собственная копия таблицы: столбцы поверх отображённого файла копируются в память,
+// номера значений в словарях сохраняются
+EmployeeTable ownedCopy(const EmployeeTable& src) {
+    EmployeeTable copy;
+    for (size_t d = 0; d < src.departments.size(); ++d) {
+        if (copy.departments.intern(src.departments.get(d)) != d) throw runtime_error("duplicate department");
+    }
+    for (size_t p = 0; p < src.positions.size(); ++p) {
+        if (copy.positions.intern(src.positions.get(p)) != p) throw runtime_error("duplicate position");
+    }
+    copy.salary.append(src.salary.data(), src.size());
+    copy.department.append(src.department.data(), src.size());
+    copy.position.append(src.position.data(), src.size());
+    copy.name.append(src.name.data(), src.size());
+    copy.names.arena.append(src.names.arena.data(), src.names.arena.size());
+    copy.names.offsets = {};
+    copy.names.offsets.append(src.names.offsets.data(), src.names.offsets.size());
+    return copy;
+}
+
+// Статистика по отделам, которая поддерживается при вставках, изменениях и удалениях строк
+// вместо пересчёта всей таблицы. У каждого отдела — сумма и количество зарплат и индекс строк
+// по зарплате с границей: первой строкой выше среднего. Когда среднее сдвигается, граница
+// проходит только через строки, сменившие сторону. Удалённые строки остаются в таблице
+// с пометкой и зарплатой -inf, номера строк не переиспользуются.
+class IncrementalDepartmentStats {
+    using Index = set<pair<double, uint32_t>>;
+
+    struct Department {
+        double sum = 0;
+        double compensation = 0;  // поправка Ноймайера: сумма не уплывает от тысяч вычитаний
+        size_t count = 0;
+        Index index;
+        Index::iterator boundary = index.end();
+        size_t above = 0;
+
+        void add(double x) {
+            double t = sum + x;
+            compensation += fabs(sum) >= fabs(x) ? (sum - t) + x : (x - t) + sum;
+            sum = t;
+        }
+
+        double mean() const { return count ? (sum + compensation) / count : 0.0; }
+    };
+
+    EmployeeTable table;
+    vector<uint8_t> live;
+    deque<Department> departments;  // deque: отделы не переезжают, итераторы границ верны
+    size_t live_rows = 0;
+    size_t above_total = 0;
+
+    Department& department(DictId d) {
+        while (departments.size() <= d) departments.emplace_back();
+        return departments[d];
+    }
+
+    void checkRow(uint32_t row) const {
+        if (row >= live.size() || !live[row]) throw out_of_range("no live row " + to_string(row));
+    }
+
+    // Граница на первую строку выше нового среднего
+    void rebalance(Department& dep) {
+        const double avg = dep.mean();
+        while (dep.boundary != dep.index.begin() && prev(dep.boundary)->first > avg) {
+            --dep.boundary;
+            ++dep.above;
+            ++above_total;
+        }
+        while (dep.boundary != dep.index.end() && dep.boundary->first <= avg) {
+            ++dep.boundary;
+            --dep.above;
+            --above_total;
+        }
+    }
+
+    void link(uint32_t row) {
+        Department& dep = department(table.department[row]);
+        const double salary = table.salary[row];
+        auto it = dep.index.emplace(salary, row).first;
+        if (dep.count && salary > dep.mean()) {
+            ++dep.above;
+            ++above_total;
+            if (dep.boundary == dep.index.end() || *it < *dep.boundary) dep.boundary = it;
+        }
+        dep.add(salary);
+        ++dep.count;
+        rebalance(dep);
+    }
+
+    void unlink(uint32_t row) {
+        Department& dep = departments[table.department[row]];
+        const double salary = table.salary[row];
+        auto it = dep.index.find({salary, row});
+        if (salary > dep.mean()) {
+            --dep.above;
+            --above_total;
+            if (dep.boundary == it) ++dep.boundary;
+        }
+        dep.index.erase(it);
+        dep.add(-salary);
+        if (--dep.count == 0) dep.sum = dep.compensation = 0;
+        rebalance(dep);
+    }
+
+public:
+    // Индексы строятся из отсортированных по отделу и зарплате строк за O(n log n)
+    explicit IncrementalDepartmentStats(const EmployeeTable& initial)
+        : table(ownedCopy(initial)), live(initial.size(), 1), live_rows(initial.size()) {
+        if (table.size() > numeric_limits<uint32_t>::max()) throw length_error("too many rows for 32-bit row ids");
+        vector<uint32_t> order(table.size());
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return make_tuple(table.department[a], table.salary[a], a) <
+                   make_tuple(table.department[b], table.salary[b], b);
+        });
+        for (uint32_t row : order) {
+            Department& dep = department(table.department[row]);
+            dep.index.emplace_hint(dep.index.end(), table.salary[row], row);
+            dep.add(table.salary[row]);
+            ++dep.count;
+        }
+        for (Department& dep : departments) {
+            dep.boundary = dep.index.upper_bound({dep.mean(), numeric_limits<uint32_t>::max()});
+            dep.above = distance(dep.boundary, dep.index.end());
+            above_total += dep.above;
+        }
+    }
+
+    // Границы — итераторы в индексы этого объекта, у копии они указывали бы в чужие множества
+    IncrementalDepartmentStats(const IncrementalDepartmentStats&) = delete;
+    IncrementalDepartmentStats& operator=(const IncrementalDepartmentStats&) = delete;
+
+    // Новая строка; возвращает её номер
+    uint32_t insert(string_view name, string_view position, string_view department_name, double salary) {
+        if (table.size() >= numeric_limits<uint32_t>::max()) throw length_error("too many rows for 32-bit row ids");
+        table.append(name, position, department_name, salary);
+        uint32_t row = static_cast<uint32_t>(table.size() - 1);
+        live.push_back(1);
+        ++live_rows;
+        link(row);
+        return row;
+    }
+
+    void updateSalary(uint32_t row, double salary) {
+        checkRow(row);
+        unlink(row);
+        table.salary.mutableData()[row] = salary;
+        link(row);
+    }
+
+    void updateDepartment(uint32_t row, string_view department_name) {
+        checkRow(row);
+        DictId d = dictId(table.departments.intern(department_name));
+        unlink(row);
+        table.department.mutableData()[row] = d;
+        link(row);
+    }
+
+    void erase(uint32_t row) {
+        checkRow(row);
+        unlink(row);
+        live[row] = 0;
+        table.salary.mutableData()[row] = -numeric_limits<double>::infinity();
+        --live_rows;
+    }
+
+    const EmployeeTable& data() const { return table; }
+    bool isLive(uint32_t row) const { return row < live.size() && live[row]; }
+    size_t rows() const { return live_rows; }
+
+    double average(DictId d) const { return d < departments.size() ? departments[d].mean() : 0.0; }
+
+    // Средние по названиям отделов, как в ProcessResult
+    map<string, double> averages() const {
+        map<string, double> result;
+        for (size_t d = 0; d < departments.size(); ++d) {
+            if (departments[d].count) result[string(table.departments.get(d))] = departments[d].mean();
+        }
+        return result;
+    }
+
+    size_t aboveCount() const { return above_total; }
+    size_t aboveCount(DictId d) const { return d < departments.size() ? departments[d].above : 0; }
+
+    bool isAbove(uint32_t row) const {
+        return isLive(row) && table.salary[row] > average(table.department[row]);
+    }
+
+    // Строки отдела выше среднего по возрастанию зарплаты
+    template <class F>
+    void forEachAbove(DictId d, F&& f) const {
+        if (d >= departments.size()) return;
+        for (auto it = departments[d].boundary; it != departments[d].index.end(); ++it) f(it->second);
+    }
+
+    // Все строки выше среднего по возрастанию номеров, как у singleThreadProcess. Строки
+    // берутся из индексов отделов от границы, столбец зарплат не просматривается; чтобы
+    // выдать их по порядку без сортировки, номера отмечаются в битовой карте и считываются
+    // из неё по словам.
+    EmployeeSelection aboveAverage() const {
+        vector<uint64_t> marked((table.size() + 63) / 64, 0);
+        for (size_t d = 0; d < departments.size(); ++d) {
+            forEachAbove(static_cast<DictId>(d), [&](uint32_t row) { marked[row >> 6] |= uint64_t(1) << (row & 63); });
+        }
+        vector<uint32_t> rows;
+        rows.reserve(above_total);
+        for (size_t w = 0; w < marked.size(); ++w) {
+            for (uint64_t bits = marked[w]; bits; bits &= bits - 1) {
+                rows.push_back(static_cast<uint32_t>(w * 64 + countr_zero(bits)));
+            }
+        }
+        return EmployeeSelection(table, move(rows));
+    }
+};
+
+// Миллисекунды с микросекундной точностью
+string formatMs(chrono::nanoseconds ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f ms", ns.count() / 1e6);
+    return buf;
+}
+
 void printResults(const ProcessResult& result, const string& label) {
     cout << "\n\n";
     cout << label << "\n";
     cout << "\n";
-    cout << "Время обработки: " << result.execution_time.count() << " ms\n\n";
+    cout << "Время обработки: " << formatMs(result.execution_time) << " (группировка "
+         << formatMs(chrono::nanoseconds(result.phases.group_ns)) << ", средние "
+         << formatMs(chrono::nanoseconds(result.phases.average_ns)) << ", отбор "
+         << formatMs(chrono::nanoseconds(result.phases.filter_ns)) << ", сборка "
+         << formatMs(chrono::nanoseconds(result.phases.merge_ns)) << ")\n";
+    cout << "Размещение потоков: " << result.placement << "\n\n";
     
     cout << "--- Средняя зарплата по отделам ---\n";
     for (const auto& [dept, avg] : result.dept_avg_salary) {
@@ -176,26 +1751,532 @@ void printResults(const ProcessResult& result, const string& label) {
          << setw(25) << "Зарплата\n";
     cout << string(80, '-') << "\n";
     
-    for (const auto& emp : result.employees_above_avg) {
-        cout << left << setw(26) << emp.name 
-             << setw(25) << emp.position 
-             << setw(25) << emp.department 
-             << setw(25) << fixed << setprecision(2) << emp.salary << "\n";
+    for (EmployeeRef emp : result.employees_above_avg) {
+        cout << left << setw(26) << emp.name() 
+             << setw(25) << emp.position() 
+             << setw(25) << emp.department() 
+             << setw(25) << fixed << setprecision(2) << emp.salary() << "\n";
+    }
+}
+
+// Отчёт по произвольной группировке: название группы составляется из значений
+// ключевых столбцов через " / "
+void printGroupReport(const GroupBy<FullStats>& groups, const vector<const StringPool*>& dictionaries,
+                      const string& title) {
+    cout << "\n--- " << title << " ---\n";
+    cout << left << setw(40) << "Группа" << right << setw(10) << "Кол-во" << setw(14) << "Средняя"
+         << setw(14) << "Мин" << setw(14) << "Макс" << setw(14) << "Ст. откл." << "\n";
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const FullStats& st = groups[g];
+        if (!st.count) continue;
+        string label;
+        vector<DictId> ids = groups.decode(g);
+        for (size_t k = 0; k < ids.size(); ++k) {
+            label += (k ? " / " : "") + string(dictionaries[k]->get(ids[k]));
+        }
+        cout << left << setw(40) << label << right << setw(10) << st.count << fixed << setprecision(2)
+             << setw(14) << st.mean() << setw(14) << st.min << setw(14) << st.max
+             << setw(14) << sqrt(st.variance()) << "\n";
+    }
+    cout << left;
+}
+
+bool endsWith(const string& s, const string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// "1000", "10k", "5m", "2g" — десятичные множители
+bool parseCount(string_view text, size_t& value) {
+    size_t multiplier = 1;
+    if (!text.empty()) {
+        switch (text.back()) {
+        case 'k': case 'K': multiplier = 1000; break;
+        case 'm': case 'M': multiplier = 1000000; break;
+        case 'g': case 'G': multiplier = 1000000000; break;
+        }
+        if (multiplier > 1) text.remove_suffix(1);
+    }
+    auto [ptr, ec] = from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != errc() || ptr != text.data() + text.size() || value > numeric_limits<size_t>::max() / multiplier) {
+        return false;
+    }
+    value *= multiplier;
+    return true;
+}
+
+// Положительные числа через запятую
+bool parseCountList(const string& text, vector<size_t>& values) {
+    values.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = min(text.find(',', start), text.size());
+        size_t v;
+        if (!parseCount(string_view(text).substr(start, comma - start), v) || v == 0) return false;
+        values.push_back(v);
+        start = comma + 1;
+    }
+    return true;
+}
+
+// Параметры пакетного замера (--bench)
+struct BenchConfig {
+    vector<size_t> sizes = {1000000};  // строк в наборе; при слабом масштабировании — на поток
+    vector<size_t> threads;            // перебираемое количество потоков
+    int warmup = 1;                    // прогревочные прогоны, в статистику не входят
+    int repetitions = 5;               // измеряемые прогоны
+    bool strong = true;                // объём постоянный, растёт число потоков
+    bool weak = true;                  // объём растёт вместе с числом потоков
+    string json_path;                  // куда сохранить таблицу масштабирования в JSON
+    string csv_path;                   // куда сохранить таблицу масштабирования в CSV
+    size_t deltas = 0;                 // изменений для замера инкрементальной статистики
+};
+
+// Строка таблицы масштабирования. Время и фазы — прогона с медианным временем.
+// strong: speedup — время однопоточной обработки того же набора к времени пула.
+// weak: набор в threads раз больше, efficiency — время однопоточной обработки
+// набора на один поток к времени пула, speedup = efficiency * threads.
+struct ScalingRow {
+    string scaling;  // strong | weak
+    string mode;     // single — singleThreadProcess, pool — multiThreadProcess
+    size_t rows = 0;
+    size_t threads = 1;
+    PhaseTimes phases;
+    size_t median_ns = 0;
+    size_t min_ns = 0;
+    double rows_per_sec = 0;
+    double speedup = 1;
+    double efficiency = 1;
+    size_t steals = 0;
+    bool check_ok = true;  // отбор пула совпал с однопоточным
+    string placement = "none";
+};
+
+// Прогревает и повторяет run; в last остаётся результат последнего прогона
+template <class Run>
+ScalingRow measure(const BenchConfig& cfg, size_t rows, Run&& run, ProcessResult& last) {
+    for (int i = 0; i < cfg.warmup; ++i) run();
+    vector<ScalingRow> samples;
+    for (int i = 0; i < cfg.repetitions; ++i) {
+        last = run();
+        ScalingRow sample;
+        sample.median_ns = last.execution_time.count();
+        sample.phases = last.phases;
+        sample.steals = last.steals;
+        samples.push_back(sample);
+    }
+    sort(samples.begin(), samples.end(),
+         [](const ScalingRow& a, const ScalingRow& b) { return a.median_ns < b.median_ns; });
+    ScalingRow row = samples[(samples.size() - 1) / 2];
+    row.rows = rows;
+    row.min_ns = samples.front().median_ns;
+    row.rows_per_sec = rows * 1e9 / max<size_t>(row.median_ns, 1);
+    return row;
+}
+
+void printScalingRow(const ScalingRow& r) {
+    auto ms = [](size_t ns) { return ns / 1e6; };
+    cout << left << setw(7) << r.scaling << setw(7) << r.mode << right << setw(12) << r.rows << setw(5)
+         << r.threads << fixed << setprecision(3) << setw(10) << ms(r.phases.group_ns) << setw(10)
+         << ms(r.phases.average_ns) << setw(10) << ms(r.phases.filter_ns) << setw(10) << ms(r.phases.merge_ns)
+         << setw(11) << ms(r.median_ns) << setprecision(0) << setw(14) << r.rows_per_sec << setprecision(2)
+         << setw(9) << r.speedup << setw(8) << r.efficiency << (r.check_ok ? "" : "  ОТБОР НЕ СОВПАЛ") << "\n"
+         << left;
+}
+
+// Набор для замера: файл, если задан, иначе синтетические данные
+EmployeeTable benchTable(const string& input_path, size_t rows, const GeneratorSpec& spec, WorkStealingPool& pool) {
+    if (input_path.empty()) return generateEmployees(rows, spec, pool);
+    return endsWith(input_path, ".csv") ? loadCsv(input_path, pool) : mapColumnar(input_path);
+}
+
+// Пул из threads потоков на наборе table. Без baseline сначала замеряется
+// однопоточная обработка того же набора, она и становится базой
+void benchThreads(const BenchConfig& cfg, const string& scaling, const EmployeeTable& table,
+                  const ScalingRow* baseline, size_t threads, vector<ScalingRow>& out) {
+    ProcessResult reference = singleThreadProcess(table);
+    if (!baseline) {
+        ProcessResult last;
+        ScalingRow single = measure(cfg, table.size(), [&] { return singleThreadProcess(table); }, last);
+        single.scaling = scaling;
+        single.mode = "single";
+        out.push_back(single);
+        printScalingRow(single);
+        baseline = &out.back();
+    }
+    size_t baseline_ns = baseline->median_ns;
+
+    vector<int> plan = planPlacement(topology, pin_policy, static_cast<int>(threads));
+    WorkStealingPool pool(static_cast<int>(threads), plan);
+    placeEmployees(table, pool, plan);
+    ProcessResult last;
+    ScalingRow row = measure(cfg, table.size(), [&] { return multiThreadProcess(table, pool); }, last);
+    row.scaling = scaling;
+    row.mode = "pool";
+    row.threads = threads;
+    row.placement = describePlacement(pin_policy, plan, pool.pinFailures());
+    row.check_ok = last.employees_above_avg.rowIds() == reference.employees_above_avg.rowIds();
+    double ratio = static_cast<double>(baseline_ns) / max<size_t>(row.median_ns, 1);
+    if (scaling == "strong") {
+        row.speedup = ratio;
+        row.efficiency = ratio / threads;
+    } else {
+        row.efficiency = ratio;
+        row.speedup = row.efficiency * threads;
+    }
+    out.push_back(row);
+    printScalingRow(row);
+}
+
+vector<ScalingRow> runBench(const BenchConfig& cfg, const string& input_path, const GeneratorSpec& spec) {
+    vector<ScalingRow> rows;
+    size_t max_threads = *max_element(cfg.threads.begin(), cfg.threads.end());
+    WorkStealingPool loader(static_cast<int>(max_threads), {});
+    // набор из файла один, перебор размеров к нему не применим
+    vector<size_t> sizes = input_path.empty() ? cfg.sizes : vector<size_t>{0};
+
+    if (!cfg.strong && !cfg.weak) return rows;
+    cout << left << setw(7) << "scale" << setw(7) << "mode" << right << setw(12) << "rows" << setw(5) << "thr"
+         << setw(10) << "group ms" << setw(10) << "avg ms" << setw(10) << "filter ms" << setw(10) << "merge ms"
+         << setw(11) << "total ms" << setw(14) << "rows/s" << setw(9) << "speedup" << setw(8) << "eff" << "\n"
+         << left;
+
+    if (cfg.strong) {
+        for (size_t size : sizes) {
+            EmployeeTable table = benchTable(input_path, size, spec, loader);
+            size_t baseline = rows.size();
+            for (size_t t : cfg.threads) {
+                benchThreads(cfg, "strong", table, rows.size() > baseline ? &rows[baseline] : nullptr,
+                           t, rows);
+            }
+        }
+    }
+    if (cfg.weak && !input_path.empty()) {
+        cout << "Слабое масштабирование пропущено: набор из файла не растёт с числом потоков\n";
+    } else if (cfg.weak) {
+        for (size_t size : sizes) {
+            size_t baseline = rows.size();
+            for (size_t t : cfg.threads) {
+                if (size > numeric_limits<size_t>::max() / t) throw length_error("weak scaling dataset too large");
+                if (rows.size() == baseline) {
+                    // однопоточная обработка набора на один поток — база для всех t
+                    EmployeeTable base = generateEmployees(size, spec, loader);
+                    ProcessResult last;
+                    ScalingRow single = measure(cfg, size, [&] { return singleThreadProcess(base); }, last);
+                    single.scaling = "weak";
+                    single.mode = "single";
+                    rows.push_back(single);
+                    printScalingRow(single);
+                }
+                EmployeeTable table = generateEmployees(size * t, spec, loader);
+                benchThreads(cfg, "weak", table, &rows[baseline], t, rows);
+            }
+        }
+    }
+    return rows;
+}
+
+// Замер инкрементального движка: deltas случайных изменений набора из rows строк —
+// вставок, изменений зарплат, переводов между отделами и удалений. После них средние
+// и отбор сверяются с полным пересчётом живых строк. Возвращает false при расхождении.
+bool runIncrementalBench(size_t rows, size_t deltas, const GeneratorSpec& spec, WorkStealingPool& loader) {
+    auto elapsed_ns = [](auto start) {
+        return static_cast<size_t>(chrono::duration_cast<chrono::nanoseconds>(
+                                       chrono::high_resolution_clock::now() - start).count());
+    };
+    EmployeeTable initial = generateEmployees(rows, spec, loader);
+    auto build_start = chrono::high_resolution_clock::now();
+    IncrementalDepartmentStats stats(initial);
+    size_t build_ns = elapsed_ns(build_start);
+    initial = EmployeeTable();
+
+    SplitMix64 rng(spec.seed ^ 0x5851F42D4C957F2Dull);
+    auto randomLive = [&]() {
+        uint32_t row;
+        do row = static_cast<uint32_t>(rng.next() % stats.data().size());
+        while (!stats.isLive(row));
+        return row;
+    };
+    auto randomDepartment = [&]() {
+        return stats.data().departments.get(rng.next() % stats.data().departments.size());
+    };
+
+    vector<size_t> op_ns(deltas);
+    for (size_t i = 0; i < deltas; ++i) {
+        uint64_t kind = rng.next() % 10;
+        double salary = 40000 + rng.uniform() * 110000;
+        // строка и отдел выбираются до замера; последнюю строку не трогаем, чтобы было из чего выбирать
+        bool insert = kind < 2 || stats.rows() <= 1;
+        uint32_t row = insert ? 0 : randomLive();
+        string_view dept = randomDepartment();
+        auto start = chrono::high_resolution_clock::now();
+        if (insert) stats.insert("# new " + to_string(i), "Разработчик", dept, salary);
+        else if (kind < 8) stats.updateSalary(row, salary);
+        else if (kind < 9) stats.updateDepartment(row, dept);
+        else stats.erase(row);
+        op_ns[i] = elapsed_ns(start);
+    }
+    sort(op_ns.begin(), op_ns.end());
+    auto op_percentile = [&](double p) {
+        return op_ns.empty() ? 0 : op_ns[min(op_ns.size() - 1, static_cast<size_t>(p * op_ns.size()))];
+    };
+
+    auto query_start = chrono::high_resolution_clock::now();
+    map<string, double> averages = stats.averages();
+    size_t above = stats.aboveCount();
+    size_t query_ns = elapsed_ns(query_start);
+    auto select_start = chrono::high_resolution_clock::now();
+    EmployeeSelection selection = stats.aboveAverage();
+    size_t select_ns = elapsed_ns(select_start);
+
+    // Полный пересчёт по живым строкам; номера строк переводятся обратно в номера движка
+    EmployeeTable live_rows;
+    vector<uint32_t> original;
+    const EmployeeTable& data = stats.data();
+    for (uint32_t row = 0; row < data.size(); ++row) {
+        if (!stats.isLive(row)) continue;
+        live_rows.append(data.names.get(data.name[row]), data.positions.get(data.position[row]),
+                         data.departments.get(data.department[row]), data.salary[row]);
+        original.push_back(row);
+    }
+    ProcessResult rescan = singleThreadProcess(live_rows);
+    vector<uint32_t> rescan_rows;
+    for (uint32_t row : rescan.employees_above_avg.rowIds()) rescan_rows.push_back(original[row]);
+    bool ok = rescan_rows == selection.rowIds() && above == selection.size() &&
+              averages.size() == rescan.dept_avg_salary.size();
+    for (const auto& [dept, avg] : rescan.dept_avg_salary) {
+        ok = ok && averages.count(dept) && fabs(averages[dept] - avg) <= 1e-9 * fabs(avg);
+    }
+
+    cout << "\n> Инкрементальная статистика: " << rows << " строк, " << deltas << " изменений\n"
+         << "Построение индексов:   " << formatMs(chrono::nanoseconds(build_ns)) << "\n"
+         << "Изменение, p50/p99:    " << op_percentile(0.5) << " / " << op_percentile(0.99) << " ns\n"
+         << "Средние и число выше:  " << query_ns << " ns\n"
+         << "Отбор выше среднего:   " << formatMs(chrono::nanoseconds(select_ns)) << " (" << selection.size()
+         << " строк)\n"
+         << "Полный пересчёт:       " << formatMs(rescan.execution_time) << "\n"
+         << "Сверка с пересчётом:   " << (ok ? "совпадает" : "НЕ СОВПАДАЕТ") << "\n";
+    return ok;
+}
+
+// Формат CSV: по строке на ScalingRow, времена в наносекундах
+void writeScalingCsv(const string& path, const vector<ScalingRow>& rows) {
+    ofstream out(path);
+    if (!out) throw runtime_error("cannot write " + path);
+    out << "scaling,mode,rows,threads,group_ns,average_ns,filter_ns,merge_ns,median_ns,min_ns,"
+           "rows_per_sec,speedup,efficiency,steals,check_ok,placement\n";
+    for (const auto& r : rows) {
+        out << r.scaling << "," << r.mode << "," << r.rows << "," << r.threads << "," << r.phases.group_ns << ","
+            << r.phases.average_ns << "," << r.phases.filter_ns << "," << r.phases.merge_ns << ","
+            << r.median_ns << "," << r.min_ns << "," << fixed << setprecision(1) << r.rows_per_sec << ","
+            << setprecision(3) << r.speedup << "," << r.efficiency << "," << r.steals << "," << r.check_ok
+            << ",\"" << r.placement << "\"\n";
+    }
+}
+
+void writeScalingJson(const string& path, const vector<ScalingRow>& rows, const BenchConfig& cfg,
+                      const GeneratorSpec& spec) {
+    ofstream out(path);
+    if (!out) throw runtime_error("cannot write " + path);
+    out << "{\n  \"topology\": \"" << topology.describe() << "\",\n"
+        << "  \"filter_kernel\": \"" << selectKernel().name << "\",\n"
+        << "  \"generator\": \"" << spec.describe() << "\",\n"
+        << "  \"warmup\": " << cfg.warmup << ",\n"
+        << "  \"repetitions\": " << cfg.repetitions << ",\n"
+        << "  \"results\": [";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const auto& r = rows[i];
+        out << (i ? "," : "") << "\n    {\"scaling\": \"" << r.scaling << "\""
+            << ", \"mode\": \"" << r.mode << "\""
+            << ", \"rows\": " << r.rows
+            << ", \"threads\": " << r.threads
+            << ", \"group_ns\": " << r.phases.group_ns
+            << ", \"average_ns\": " << r.phases.average_ns
+            << ", \"filter_ns\": " << r.phases.filter_ns
+            << ", \"merge_ns\": " << r.phases.merge_ns
+            << ", \"median_ns\": " << r.median_ns
+            << ", \"min_ns\": " << r.min_ns
+            << ", \"rows_per_sec\": " << fixed << setprecision(1) << r.rows_per_sec
+            << ", \"speedup\": " << setprecision(3) << r.speedup
+            << ", \"efficiency\": " << r.efficiency
+            << ", \"steals\": " << r.steals
+            << ", \"check_ok\": " << (r.check_ok ? "true" : "false")
+            << ", \"placement\": \"" << r.placement << "\"}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+vector<size_t> defaultThreadCounts() {
+    size_t hw = max(1u, thread::hardware_concurrency());
+    vector<size_t> counts;
+    for (size_t t = 1; t < hw; t *= 2) counts.push_back(t);
+    counts.push_back(hw);
+    return counts;
+}
+
+// Аргументы обоих режимов
+struct Options {
+    string input_path;
+    string write_path;
+    string generate_path;
+    bool stream = false;
+    bool bench = false;
+    GeneratorSpec spec;
+    BenchConfig bench_cfg;
+};
+
+void printUsage(const char* prog) {
+    cout << "Использование: " << prog << " [ФАЙЛ] [параметры]\n"
+         << "  ФАЙЛ               данные из .csv или колоночного файла вместо генерации\n"
+         << "  --stream           CSV обрабатывается кусками, не загружаясь в память целиком\n"
+         << "  --write ФАЙЛ       сохранить данные в .csv или колоночный файл (по расширению)\n"
+         << "  --generate ФАЙЛ    сгенерировать данные сразу в колоночный файл\n"
+         << "  --dist ЗАКОН       распределение групп: cyclic (по умолчанию), uniform, zipf[:S]\n"
+         << "  --departments N    число отделов (по умолчанию 5)\n"
+         << "  --positions N      число должностей (по умолчанию 5)\n"
+         << "  --seed N           зерно генератора (по умолчанию 42)\n"
+         << "Пакетный замер без вопросов:\n"
+         << "  --bench            включить пакетный режим\n"
+         << "  --sizes СПИСОК     размеры наборов, например 1m,10m (по умолчанию 1m)\n"
+         << "  --threads СПИСОК   число потоков (по умолчанию степени двойки до числа ядер)\n"
+         << "  --warmup N         прогревочные прогоны (по умолчанию 1)\n"
+         << "  --reps N           измеряемые прогоны (по умолчанию 5)\n"
+         << "  --scaling ВИД      strong, weak, both (по умолчанию) или none\n"
+         << "  --deltas N         после замеров: N случайных изменений первого набора из --sizes\n"
+         << "                     через инкрементальную статистику со сверкой\n"
+         << "  --pin ПОЛИТИКА     none (по умолчанию), compact, scatter, one-per-core, smt-pairs\n"
+         << "  --json ФАЙЛ        сохранить таблицу масштабирования в JSON\n"
+         << "  --csv ФАЙЛ         сохранить таблицу масштабирования в CSV\n"
+         << "Код возврата пакетного режима 3, если отбор пула или инкрементальной статистики\n"
+         << "разошёлся с однопоточным пересчётом\n";
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    BenchConfig& cfg = opt.bench_cfg;
+    cfg.threads = defaultThreadCounts();
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return false;
+        }
+        if (arg == "--stream" || arg == "--bench") {
+            (arg == "--stream" ? opt.stream : opt.bench) = true;
+            continue;
+        }
+        if (arg.empty() || arg[0] != '-') {
+            opt.input_path = arg;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Не задано значение " << arg << "\n";
+            return false;
+        }
+        string value = argv[++i];
+        size_t n = 0;
+        bool ok = true;
+        if (arg == "--write") opt.write_path = value;
+        else if (arg == "--generate") opt.generate_path = value;
+        else if (arg == "--dist") ok = parseDistribution(value, opt.spec);
+        else if (arg == "--departments") ok = parseCount(value, opt.spec.departments);
+        else if (arg == "--positions") ok = parseCount(value, opt.spec.positions);
+        else if (arg == "--seed") ok = parseCount(value, opt.spec.seed);
+        else if (arg == "--sizes") ok = parseCountList(value, cfg.sizes);
+        else if (arg == "--threads") {
+            ok = parseCountList(value, cfg.threads) &&
+                 all_of(cfg.threads.begin(), cfg.threads.end(), [](size_t t) { return t <= 4096; });
+        }
+        else if (arg == "--warmup") {
+            ok = parseCount(value, n) && n <= 1000;
+            cfg.warmup = static_cast<int>(n);
+        }
+        else if (arg == "--reps") {
+            ok = parseCount(value, n) && n && n <= 100000;
+            cfg.repetitions = static_cast<int>(n);
+        }
+        else if (arg == "--scaling") {
+            ok = value == "strong" || value == "weak" || value == "both" || value == "none";
+            cfg.strong = value == "strong" || value == "both";
+            cfg.weak = value == "weak" || value == "both";
+        }
+        else if (arg == "--deltas") ok = parseCount(value, cfg.deltas);
+        else if (arg == "--pin") ok = parsePinPolicy(value, pin_policy);
+        else if (arg == "--json") cfg.json_path = value;
+        else if (arg == "--csv") cfg.csv_path = value;
+        else {
+            cerr << "Неизвестный параметр " << arg << "\n";
+            printUsage(argv[0]);
+            return false;
+        }
+        if (!ok) {
+            cerr << "Неверное значение " << arg << ": " << value << "\n";
+            return false;
+        }
+    }
+    if (opt.stream && !endsWith(opt.input_path, ".csv")) {
+        cerr << "Ошибка: --stream работает только с CSV\n";
+        return false;
+    }
+    if (!opt.generate_path.empty() && !opt.input_path.empty()) {
+        cerr << "Ошибка: --generate не сочетается с входным файлом\n";
+        return false;
+    }
+    if (opt.bench && (opt.stream || !opt.generate_path.empty() || !opt.write_path.empty())) {
+        cerr << "Ошибка: --bench не сочетается с --stream, --generate и --write\n";
+        return false;
     }
+    return true;
 }
 
-int main() {
-    int ARRAY_SIZE;
+int runBenchMode(const Options& opt) {
+    const BenchConfig& cfg = opt.bench_cfg;
+    cout << "> Пакетный замер обработки данных о сотрудниках\n"
+         << "Топология:    " << topology.describe() << "\n"
+         << "Ядро фильтра: " << selectKernel().name << "\n"
+         << "Данные:       " << (opt.input_path.empty() ? opt.spec.describe() : opt.input_path) << "\n"
+         << "Прогоны:      " << cfg.warmup << " прогревочных, " << cfg.repetitions << " измеряемых\n\n";
+    vector<ScalingRow> rows;
+    bool checks_ok = true;
+    try {
+        rows = runBench(cfg, opt.input_path, opt.spec);
+        if (!cfg.json_path.empty()) writeScalingJson(cfg.json_path, rows, cfg, opt.spec);
+        if (!cfg.csv_path.empty()) writeScalingCsv(cfg.csv_path, rows);
+        if (cfg.deltas) {
+            WorkStealingPool loader(static_cast<int>(cfg.threads.back()), {});
+            checks_ok = runIncrementalBench(cfg.sizes.front(), cfg.deltas, opt.spec, loader);
+        }
+    } catch (const exception& e) {
+        cerr << "Ошибка: " << e.what() << "\n";
+        return 1;
+    }
+    checks_ok = checks_ok && all_of(rows.begin(), rows.end(), [](const ScalingRow& r) { return r.check_ok; });
+    return checks_ok ? 0 : 3;
+}
+
+// Без --bench: размер набора, число потоков и закрепление спрашиваются с клавиатуры
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) return 1;
+    topology = Topology::detect();
+    if (opt.bench) return runBenchMode(opt);
+
+    long long ARRAY_SIZE = 0;
     int NUM_THREADS;
+    const string& input_path = opt.input_path;
+    const string& write_path = opt.write_path;
+    const string& generate_path = opt.generate_path;
+    const GeneratorSpec& spec = opt.spec;
     
     cout << "> Многопоточная обработка данных о сотрудниках\n\n";
     
-    cout << "Введите размер массива (количество сотрудников): ";
-    cin >> ARRAY_SIZE;
-    
-    if (ARRAY_SIZE <= 0) {
-        cerr << "Ошибка: размер массива должен быть положительным числом!\n";
-        return 1;
+    if (input_path.empty()) {
+        cout << "Введите размер массива (количество сотрудников): ";
+        cin >> ARRAY_SIZE;
+        
+        if (ARRAY_SIZE <= 0) {
+            cerr << "Ошибка: размер массива должен быть положительным числом!\n";
+            return 1;
+        }
     }
     
     cout << "Введите количество потоков: ";
@@ -206,19 +2287,82 @@ int main() {
         return 1;
     }
 
-    cout << "\nГенерирование данных...\n";
-    auto employees = generateEmployees(ARRAY_SIZE);
+    string policy_name;
+    cout << "Закрепление потоков (none, compact, scatter, one-per-core, smt-pairs): ";
+    cin >> policy_name;
+
+    if (!parsePinPolicy(policy_name, pin_policy)) {
+        cerr << "Ошибка: неизвестная политика закрепления " << policy_name << "\n";
+        return 1;
+    }
+
+    vector<int> plan = planPlacement(topology, pin_policy, NUM_THREADS);
+    WorkStealingPool pool(NUM_THREADS, plan);
+    
+    if (opt.stream) {
+        constexpr size_t STREAM_CHUNK_BYTES = 256 << 20;
+        cout << "\nПотоковая обработка " << input_path << "...\n";
+        StreamResult result;
+        try {
+            result = streamCsv(input_path, pool, STREAM_CHUNK_BYTES);
+        } catch (const exception& e) {
+            cerr << "Ошибка: " << e.what() << "\n";
+            return 1;
+        }
+        cout << "Строк: " << result.rows << " | Кусков: " << result.chunks
+             << " | Время: " << formatMs(result.execution_time) << "\n\n";
+        cout << "--- Средняя зарплата по отделам ---\n";
+        for (const auto& [dept, avg] : result.dept_avg_salary) {
+            cout << "  " << left << setw(20) << dept << ": " << fixed << setprecision(2) << avg << " руб.\n";
+        }
+        cout << "\nСотрудников с зарплатой выше средней по отделу: " << result.above_avg << "\n";
+        return 0;
+    }
+    
+    EmployeeTable employees;
+    auto load_start = chrono::high_resolution_clock::now();
+    try {
+        if (!generate_path.empty()) {
+            cout << "\nГенерирование в " << generate_path << " (" << spec.describe() << ")...\n";
+            generateColumnarFile(generate_path, ARRAY_SIZE, spec, pool);
+            employees = mapColumnar(generate_path);
+        } else if (input_path.empty()) {
+            cout << "\nГенерирование данных (" << spec.describe() << ")...\n";
+            employees = generateEmployees(ARRAY_SIZE, spec, pool);
+        } else {
+            cout << "\nЗагрузка " << input_path << "...\n";
+            employees = endsWith(input_path, ".csv") ? loadCsv(input_path, pool) : mapColumnar(input_path);
+        }
+        if (!write_path.empty()) {
+            if (endsWith(write_path, ".csv")) writeCsv(write_path, employees);
+            else writeColumnar(write_path, employees);
+            cout << "Данные сохранены в " << write_path << "\n";
+        }
+    } catch (const exception& e) {
+        cerr << "Ошибка: " << e.what() << "\n";
+        return 1;
+    }
+    auto load_ms = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - load_start);
+    cout << "Строк: " << employees.size() << " | Загрузка: " << load_ms.count() << " ms\n";
+    placeEmployees(employees, pool, plan);
     
     cout << "Однопоточная обработка...\n";
     auto single_result = singleThreadProcess(employees);
     
     cout << "Многопоточная обработка...\n";
-    auto multi_result = multiThreadProcess(employees, NUM_THREADS);
+    auto multi_result = multiThreadProcess(employees, pool);
+    multi_result.placement = describePlacement(pin_policy, plan, pool.pinFailures());
     
     cout << "\n> СРАВНЕНИЕ\n";
-    cout << "Однопоточно:  " << single_result.execution_time.count() << " ms\n";
-    cout << "Многопоточно: " << multi_result.execution_time.count() << " ms\n";
-    double speedup = (double)single_result.execution_time.count() / multi_result.execution_time.count();
+    cout << "Топология:    " << topology.describe() << "\n";
+    cout << "Размещение:   " << multi_result.placement << "\n";
+    cout << "Ядро фильтра: " << selectKernel().name << "\n";
+    cout << "Перехваты:    " << multi_result.steals << " (морсель "
+         << pool.morselSize(employees.size()) << " строк)\n";
+    cout << "Однопоточно:  " << formatMs(single_result.execution_time) << "\n";
+    cout << "Многопоточно: " << formatMs(multi_result.execution_time) << "\n";
+    double speedup = static_cast<double>(single_result.execution_time.count()) /
+                     max<long long>(multi_result.execution_time.count(), 1);
     cout << "Ускорение:    " << fixed << setprecision(2) << speedup << "x\n";
     
     char show_results;
@@ -228,6 +2372,15 @@ int main() {
     if (show_results == 'y' || show_results == 'Y') {
         printResults(single_result, "ОДНОПОТОЧНАЯ ОБРАБОТКА");
         printResults(multi_result, "МНОГОПОТОЧНАЯ ОБРАБОТКА");
+
+        GroupBy<FullStats> by_position({employees.positionKey()});
+        by_position.add(employees.salary, 0, employees.size());
+        printGroupReport(by_position, {&employees.positions}, "Зарплаты по должностям");
+
+        GroupBy<FullStats> by_dept_position({employees.departmentKey(), employees.positionKey()});
+        by_dept_position.add(employees.salary, 0, employees.size());
+        printGroupReport(by_dept_position, {&employees.departments, &employees.positions},
+                         "Зарплаты по отделам и должностям");
     }
     
     return 0;